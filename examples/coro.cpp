@@ -0,0 +1,44 @@
+#include <iostream>
+
+#include "red1z/coro.h"
+
+using red1z::coro::Task;
+
+//each task runs its commands one after the other, the commands of the
+//different tasks are pipelined on the shared connection
+Task<> counter(red1z::coro::Redis& r, int id, int n) {
+  auto const key = "coro:counter:" + std::to_string(id);
+  co_await r.del(key);
+  for (int i = 0; i < n; ++i) {
+    co_await r.incr(key);
+  }
+  auto v = co_await r.get(key);
+  std::cout << key << " = " << *v << '\n';
+}
+
+Task<std::int64_t> total(red1z::coro::Redis& r, int tasks) {
+  std::int64_t sum = 0;
+  for (int i = 0; i < tasks; ++i) {
+    auto v = co_await r.get("coro:counter:" + std::to_string(i));
+    sum += std::stoll(*v);
+  }
+  co_return sum;
+}
+
+Task<> report(red1z::coro::Redis& r, int tasks) {
+  std::cout << "total = " << co_await total(r, tasks) << '\n';
+}
+
+int main(int, char **) {
+  red1z::coro::Reactor reactor;
+  red1z::coro::Redis r(reactor, "localhost", 6379, 0, "password");
+
+  int const tasks = 10;
+  for (int i = 0; i < tasks; ++i) {
+    reactor.spawn(counter(r, i, 1000));
+  }
+  reactor.run();
+
+  reactor.spawn(report(r, tasks));
+  reactor.run();
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+
+#include "red1z/sentinel.h"
+#include <chrono>
+#include <thread>
+
+// writes a counter every 100ms to the primary of `mymaster`, following its
+// failovers, e.g. with a local sentinel:
+//
+//   redis-cli -p 26379 sentinel failover mymaster
+int main(int argc, char **argv) {
+  using namespace std::chrono_literals;
+  std::vector<red1z::Endpoint> sentinels;
+  for (int i = 1; i < argc; ++i) {
+    sentinels.push_back(red1z::Endpoint::parse(argv[i]));
+  }
+  if (sentinels.empty()) {
+    sentinels.push_back(red1z::Endpoint::parse("redis://localhost:26379"));
+  }
+
+  red1z::Options options;
+  options.connect_timeout = 500ms;
+  red1z::SentinelRedis r(
+      "mymaster", sentinels,
+      red1z::Endpoint::parse("redis://:password@mymaster/0", options));
+
+  for (int i = 0; i < 600; ++i) {
+    auto const address = r.primary_address();
+    try {
+      std::cout << address.host << ':' << address.port << " counter = "
+                << r.incr("sentinel:counter") << '\n';
+    } catch (red1z::Error const &e) {
+      std::cout << address.host << ':' << address.port << " error: "
+                << e.what() << '\n';
+    }
+    std::this_thread::sleep_for(100ms);
+  }
+  std::cout << r.failovers() << " failovers\n";
+}
@@ -0,0 +1,331 @@
+// -*- C++ -*-
+#ifndef RED1Z_ASYNC_H
+#define RED1Z_ASYNC_H
+
+#include "red1z/context.h"
+#include "red1z/interfaces.h"
+#include "red1z/parser.h"
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+namespace red1z {
+  /// event flags wanted on the file descriptor of a non-blocking connection
+  namespace events {
+    constexpr int read = 1;
+    constexpr int write = 2;
+  } // namespace events
+
+  namespace impl {
+    /// notified once the reply of a submitted command is read
+    struct Completion {
+      virtual void complete(Reply &&r) = 0;
+      virtual void fail(std::exception_ptr e) = 0;
+
+    protected:
+      ~Completion() = default;
+    };
+
+    /// The non-blocking side of a connection, driven by an external event
+    /// loop: the loop polls fd() for events(), calls on_readable() and
+    /// on_writable() when the descriptor is ready, and completions are
+    /// notified in order as their replies are parsed (incrementally, by a
+    /// ReplyParser).
+    class AsyncContext {
+      Context m_ctx;
+      std::string m_out;
+      std::size_t m_out_pos = 0;
+      std::vector<char> m_in;
+      ReplyParser m_parser;
+      std::deque<Completion *> m_pending;
+      std::exception_ptr m_broken;
+      std::function<void(int)> m_on_events;
+
+    public:
+      /// connects (and authenticates) synchronously, then switches the
+      /// socket to non-blocking mode
+      AsyncContext(std::string const &hostname, int port, int db,
+                   std::optional<std::string> const &pass);
+
+      /// fails the commands still waiting for their reply
+      ~AsyncContext();
+
+      AsyncContext(AsyncContext const &) = delete;
+      AsyncContext &operator=(AsyncContext const &) = delete;
+
+      int fd() const {
+        return m_ctx.fd();
+      }
+
+      /// events::read, plus events::write while commands are waiting to be
+      /// sent, none once the connection is broken
+      int events() const {
+        if (m_broken) {
+          return 0;
+        }
+        return events::read | (m_out.empty() ? 0 : events::write);
+      }
+
+      /// called with the new events() whenever they change, e.g. to enable
+      /// write notifications once commands are queued
+      void on_events_changed(std::function<void(int)> f) {
+        m_on_events = std::move(f);
+      }
+
+      /// read what is available, completing the commands as soon as their
+      /// reply is parsed
+      void on_readable();
+
+      /// write what the socket accepts of the queued commands
+      void on_writable();
+
+      /// queue `cmd`, `c` is notified once its reply is read. Throws when
+      /// the connection is broken
+      void submit(std::string &&cmd, Completion *c);
+
+      std::size_t in_flight() const {
+        return m_pending.size();
+      }
+
+      bool broken() const {
+        return bool(m_broken);
+      }
+
+      DecodeContext decode_context() const {
+        return m_ctx.decode_context();
+      }
+
+      /// detach the commands waiting for their reply, which the context
+      /// then neither completes nor fails: the caller is in charge of them
+      std::deque<Completion *> release_pending() {
+        return std::exchange(m_pending, {});
+      }
+
+    private:
+      void fail(std::exception_ptr e);
+    };
+
+    template <class Cmd, class Out> class CallbackCompletion;
+  } // namespace impl
+
+  /// the pending result of a command run on an AsyncRedis
+  template <class R> class Then;
+
+  /// A non-blocking connection meant to be driven by an existing event loop
+  /// (epoll, libev...) without dedicated threads. Commands return a Then<R>
+  /// receiving the decoded result once the reply is read:
+  ///
+  ///   r.get<int>(k).then([](std::optional<int> v) { ... });
+  ///
+  /// The loop watches fd() for events() and calls on_readable() /
+  /// on_writable(), see on_events_changed() to be notified when events()
+  /// changes. Callbacks are called from on_readable().
+  class AsyncRedis : public impl::CommandInterface<AsyncRedis> {
+    // declared first: the commands failed by the destruction of m_ctx may
+    // still report to it
+    std::function<void(std::exception_ptr)> m_on_error;
+    impl::AsyncContext m_ctx;
+
+    template <class, class> friend class impl::CallbackCompletion;
+
+  public:
+    AsyncRedis(std::string const &hostname, int port = 6379, int db = 0,
+               std::optional<std::string> const &pass = std::nullopt)
+        : m_ctx(hostname, port, db, pass) {}
+
+    int fd() const {
+      return m_ctx.fd();
+    }
+
+    int events() const {
+      return m_ctx.events();
+    }
+
+    void on_events_changed(std::function<void(int)> f) {
+      m_ctx.on_events_changed(std::move(f));
+    }
+
+    void on_readable() {
+      m_ctx.on_readable();
+    }
+
+    void on_writable() {
+      m_ctx.on_writable();
+    }
+
+    std::size_t in_flight() const {
+      return m_ctx.in_flight();
+    }
+
+    /// receives the errors of the commands without an error callback,
+    /// they are ignored by default
+    void on_error(std::function<void(std::exception_ptr)> f) {
+      m_on_error = std::move(f);
+    }
+
+    template <class Cmd> auto _run(impl::Command<Cmd> &&cmd) {
+      return submit(new impl::CallbackCompletion<Cmd, void>(
+          *this, static_cast<Cmd &&>(cmd)));
+    }
+
+    template <class Cmd, class Out>
+    auto _run_into(impl::Command<Cmd> &&cmd, Out out) {
+      return submit(new impl::CallbackCompletion<Cmd, Out>(
+          *this, static_cast<Cmd &&>(cmd), out));
+    }
+
+  private:
+    template <class C> Then<typename C::result_type> submit(C *c) {
+      auto callbacks = c->callbacks();
+      try {
+        m_ctx.submit(c->take_cmd(), c);
+      } catch (...) {
+        delete c;
+        throw;
+      }
+      return Then<typename C::result_type>(std::move(callbacks));
+    }
+  };
+
+  namespace impl {
+    template <class R> struct ResultCallback {
+      using type = std::function<void(R)>;
+    };
+
+    template <> struct ResultCallback<void> {
+      using type = std::function<void()>;
+    };
+
+    /// shared by a CallbackCompletion and its Then<R>, which may outlive
+    /// each other
+    template <class R> struct Callbacks {
+      typename ResultCallback<R>::type m_then;
+      std::function<void(std::exception_ptr)> m_error;
+    };
+
+    template <class Cmd, class Out> struct bound_result {
+      using type = decltype(std::declval<Cmd const &>().process_into(
+          std::declval<Reply>(), std::declval<Out>()));
+    };
+
+    template <class Cmd> struct bound_result<Cmd, void> {
+      using type =
+          decltype(std::declval<Cmd const &>().process(std::declval<Reply>()));
+    };
+
+    template <class Out> struct OutStorage { Out m_out; };
+    template <> struct OutStorage<void> {};
+
+    /// decodes the reply of Cmd (into Out unless void) and passes the result
+    /// to the callbacks set through Then<R>, deletes itself once notified
+    template <class Cmd, class Out>
+    class CallbackCompletion final : public Completion, OutStorage<Out> {
+    public:
+      using result_type = typename bound_result<Cmd, Out>::type;
+
+    private:
+      AsyncRedis &m_redis;
+      Cmd m_cmd;
+      std::shared_ptr<Callbacks<result_type>> m_callbacks =
+          std::make_shared<Callbacks<result_type>>();
+
+    public:
+      CallbackCompletion(AsyncRedis &r, Cmd &&cmd)
+          : m_redis(r), m_cmd(std::move(cmd)) {}
+
+      template <class O>
+      CallbackCompletion(AsyncRedis &r, Cmd &&cmd, O out)
+          : OutStorage<Out>{out}, m_redis(r), m_cmd(std::move(cmd)) {}
+
+      std::string take_cmd() {
+        return std::move(m_cmd).cmd();
+      }
+
+      std::shared_ptr<Callbacks<result_type>> const &callbacks() const {
+        return m_callbacks;
+      }
+
+      void complete(Reply &&r) override {
+        std::unique_ptr<CallbackCompletion> self(this);
+        std::optional<result_holder> v;
+        try {
+          DecodeScope scope(m_redis.m_ctx.decode_context());
+          v.emplace(result_holder{decode(std::move(r))});
+        } catch (...) {
+          report(std::current_exception());
+          return;
+        }
+        if (m_callbacks->m_then) {
+          if constexpr (std::is_void_v<result_type>) {
+            m_callbacks->m_then();
+          } else {
+            m_callbacks->m_then(std::move(v->value));
+          }
+        }
+      }
+
+      void fail(std::exception_ptr e) override {
+        std::unique_ptr<CallbackCompletion> self(this);
+        report(e);
+      }
+
+    private:
+      struct Unit {};
+      struct result_holder {
+        std::conditional_t<std::is_void_v<result_type>, Unit, result_type>
+            value;
+      };
+
+      auto decode(Reply &&r) {
+        if constexpr (std::is_void_v<result_type>) {
+          if constexpr (std::is_void_v<Out>) {
+            m_cmd.process(std::move(r));
+          } else {
+            m_cmd.process_into(std::move(r), this->m_out);
+          }
+          return Unit{};
+        } else if constexpr (std::is_void_v<Out>) {
+          return m_cmd.process(std::move(r));
+        } else {
+          return m_cmd.process_into(std::move(r), this->m_out);
+        }
+      }
+
+      void report(std::exception_ptr e) {
+        if (m_callbacks->m_error) {
+          m_callbacks->m_error(e);
+        } else if (m_redis.m_on_error) {
+          m_redis.m_on_error(e);
+        }
+      }
+    };
+  } // namespace impl
+
+  template <class R> class Then {
+    std::shared_ptr<impl::Callbacks<R>> m_callbacks;
+
+  public:
+    explicit Then(std::shared_ptr<impl::Callbacks<R>> c)
+        : m_callbacks(std::move(c)) {}
+
+    /// `f` receives the result, `on_error` the exception raised by an error
+    /// reply or a broken connection. Callbacks must not throw. They are set
+    /// in time when then() is called before the event loop reads the reply,
+    /// later they are never called
+    template <class F> void then(F &&f) {
+      m_callbacks->m_then = std::forward<F>(f);
+    }
+
+    template <class F, class G> void then(F &&f, G &&on_error) {
+      m_callbacks->m_then = std::forward<F>(f);
+      m_callbacks->m_error = std::forward<G>(on_error);
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_ASYNC_H
@@ -0,0 +1,299 @@
+// -*- C++ -*-
+#ifndef RED1Z_AUTO_PIPELINE_H
+#define RED1Z_AUTO_PIPELINE_H
+
+#include "red1z/context.h"
+#include "red1z/depth_controller.h"
+#include "red1z/interfaces.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace red1z {
+  class AutoPipeline;
+
+  namespace impl {
+    struct PendingReply {
+      std::optional<Reply> reply;
+      std::exception_ptr error;
+      bool done = false;
+      bool taken = false; // the reply was handed out
+    };
+  } // namespace impl
+
+  /// handle on the result of a command queued with AutoPipeline::defer(),
+  /// get() flushes the pending commands if needed and decodes the reply. It
+  /// may only be called once, a second call throws red1z::Error
+  template <class R> class Deferred {
+    AutoPipeline *m_owner;
+    std::shared_ptr<impl::PendingReply> m_slot;
+    std::function<R(Reply &&)> m_process;
+
+  public:
+    Deferred(AutoPipeline &owner, std::shared_ptr<impl::PendingReply> slot,
+             std::function<R(Reply &&)> process)
+        : m_owner(&owner), m_slot(std::move(slot)),
+          m_process(std::move(process)) {}
+
+    inline bool ready() const;
+    inline R get();
+  };
+
+  /// Automatic pipelining: commands are run with the usual direct API (from
+  /// any number of threads) and the ones issued while earlier ones are in
+  /// flight are queued then written together. One of the waiting callers
+  /// reads the replies of a whole batch and hands each one to its issuer,
+  /// which decodes it. Commands issued through defer() return a Deferred<R>
+  /// and are only sent when one of the results is needed.
+  ///
+  /// An AutoPipeline borrows the connection of a red1z::Redis (see
+  /// Redis::auto_pipeline()), which must not be used directly while the
+  /// AutoPipeline lives. Replies are decoded concurrently by their callers,
+  /// so reading red1z::Name is not supported.
+  class AutoPipeline : public impl::CommandInterface<AutoPipeline> {
+    struct Pending {
+      std::string cmd;
+      impl::PendingReply *slot;
+      std::shared_ptr<impl::PendingReply> keep; // deferred commands only
+    };
+
+    impl::Context &m_ctx;
+    DepthController m_depth; // batch size
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<Pending> m_pending;
+    bool m_flushing = false;
+
+    template <class> friend class Deferred;
+
+    class Defer : public impl::CommandInterface<Defer> {
+      AutoPipeline &m_owner;
+
+    public:
+      Defer(AutoPipeline &owner) : m_owner(owner) {}
+
+      template <class Cmd> auto _run(impl::Command<Cmd> &&cmd) {
+        using R = decltype(cmd.process(std::declval<Reply>()));
+        auto slot = m_owner.submit(std::move(cmd).cmd());
+        // the command (without its encoded string) decodes the reply
+        return Deferred<R>(m_owner, std::move(slot),
+                           [c = static_cast<Cmd &&>(cmd)](Reply &&r) -> R {
+                             return c.process(std::move(r));
+                           });
+      }
+
+      template <class Cmd, class Out>
+      auto _run_into(impl::Command<Cmd> &&cmd, Out out) {
+        using R = decltype(cmd.process_into(std::declval<Reply>(), out));
+        auto slot = m_owner.submit(std::move(cmd).cmd());
+        return Deferred<R>(
+            m_owner, std::move(slot),
+            [c = static_cast<Cmd &&>(cmd), out](Reply &&r) -> R {
+              return c.process_into(std::move(r), out);
+            });
+      }
+    };
+
+  public:
+    /// at most `max_batch` commands are written at once
+    AutoPipeline(impl::Context &ctx, int max_batch = 1024)
+        : m_ctx(ctx), m_depth(max_batch) {
+      check_ready();
+    }
+
+    /// the batch size is adapted to the measured latency, see
+    /// DepthController
+    AutoPipeline(impl::Context &ctx, AdaptiveDepth const &depth)
+        : m_ctx(ctx), m_depth(depth) {
+      check_ready();
+    }
+
+    AutoPipeline(AutoPipeline const &) = delete;
+    AutoPipeline &operator=(AutoPipeline const &) = delete;
+
+    ~AutoPipeline() {
+      try {
+        flush();
+      } catch (...) {
+      }
+    }
+
+    template <class Cmd> auto _run(impl::Command<Cmd> &&cmd) {
+      impl::PendingReply slot;
+      enqueue(std::move(cmd).cmd(), &slot, nullptr);
+      return cmd.process(wait(slot));
+    }
+
+    template <class Cmd, class Out>
+    auto _run_into(impl::Command<Cmd> &&cmd, Out out) {
+      impl::PendingReply slot;
+      enqueue(std::move(cmd).cmd(), &slot, nullptr);
+      return cmd.process_into(wait(slot), out);
+    }
+
+    /// queue commands without waiting for them: r.defer().get(k) returns a
+    /// Deferred<std::optional<std::string>>
+    Defer defer() {
+      return {*this};
+    }
+
+    /// send all the queued commands and read their replies
+    void flush() {
+      std::unique_lock lock(m_mutex);
+      while (not m_pending.empty() or m_flushing) {
+        if (m_flushing) {
+          m_cv.wait(lock);
+        } else {
+          flush_batch(lock);
+        }
+      }
+    }
+
+    std::size_t pending() {
+      std::lock_guard lock(m_mutex);
+      return m_pending.size();
+    }
+
+    /// current batch size and latency measurements
+    PipelineMetrics metrics() {
+      std::lock_guard lock(m_mutex);
+      return m_depth.metrics();
+    }
+
+  private:
+    void check_ready() const {
+      if (not m_ctx.ready()) {
+        throw Error("cannot start auto pipelining: requests are pending");
+      }
+    }
+
+    std::shared_ptr<impl::PendingReply> submit(std::string &&cmd) {
+      auto slot = std::make_shared<impl::PendingReply>();
+      enqueue(std::move(cmd), slot.get(), slot);
+      return slot;
+    }
+
+    void enqueue(std::string &&cmd, impl::PendingReply *slot,
+                 std::shared_ptr<impl::PendingReply> keep) {
+      std::lock_guard lock(m_mutex);
+      m_pending.push_back({std::move(cmd), slot, std::move(keep)});
+    }
+
+    bool is_done(impl::PendingReply const &slot) {
+      std::lock_guard lock(m_mutex);
+      return slot.done;
+    }
+
+    Reply wait(impl::PendingReply &slot) {
+      std::unique_lock lock(m_mutex);
+      if (slot.taken) {
+        throw Error("the result of a deferred command was already taken");
+      }
+      while (not slot.done) {
+        if (m_flushing) {
+          m_cv.wait(lock);
+        } else {
+          flush_batch(lock);
+        }
+      }
+      slot.taken = true;
+      if (slot.error) {
+        std::rethrow_exception(slot.error);
+      }
+      return std::move(*slot.reply);
+    }
+
+    /// completes a batch however flush_batch() exits: the commands left
+    /// without a reply fail with `error`, and the next batch may start
+    class BatchGuard {
+      AutoPipeline &m_owner;
+      std::vector<Pending> &m_batch;
+      std::unique_lock<std::mutex> &m_lock;
+
+    public:
+      std::exception_ptr error;
+
+      BatchGuard(AutoPipeline &owner, std::vector<Pending> &batch,
+                 std::unique_lock<std::mutex> &lock)
+          : m_owner(owner), m_batch(batch), m_lock(lock) {}
+
+      BatchGuard(BatchGuard const &) = delete;
+      BatchGuard &operator=(BatchGuard const &) = delete;
+
+      ~BatchGuard() {
+        if (!m_lock) {
+          m_lock.lock();
+        }
+        for (auto &p : m_batch) {
+          if (not p.slot->reply and not p.slot->error) {
+            p.slot->error =
+                error ? error
+                      : std::make_exception_ptr(Error("batch not sent"));
+          }
+          p.slot->done = true;
+        }
+        m_owner.m_flushing = false;
+        m_owner.m_cv.notify_all();
+      }
+    };
+
+    /// write up to m_depth.depth() pending commands and read their
+    /// replies, called with the lock held
+    void flush_batch(std::unique_lock<std::mutex> &lock) {
+      m_flushing = true;
+      int const n = std::min<int>(m_depth.depth(), m_pending.size());
+      bool const limited = static_cast<int>(m_pending.size()) > n;
+      std::vector<Pending> batch(std::make_move_iterator(m_pending.begin()),
+                                 std::make_move_iterator(m_pending.begin() + n));
+      m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+      BatchGuard guard(*this, batch, lock);
+      lock.unlock();
+
+      using clock = DepthController::clock;
+      auto const start = clock::now();
+      auto first = start;
+      try {
+        auto queue = m_ctx.start_pipeline();
+        for (auto &p : batch) {
+          queue.append(std::move(p.cmd));
+        }
+        // an error reply only fails its own command, the following replies
+        // are still read
+        for (auto &p : batch) {
+          try {
+            p.slot->reply.emplace(queue.get_reply());
+          } catch (...) {
+            p.slot->error = std::current_exception();
+          }
+          if (&p == &batch.front()) {
+            first = clock::now();
+          }
+        }
+      } catch (...) {
+        // e.g. a poisoned connection, or a failed reconnection
+        guard.error = std::current_exception();
+        return;
+      }
+      auto const end = clock::now();
+
+      lock.lock();
+      m_depth.on_batch(n, first - start, end - start, limited);
+    }
+  };
+
+  template <class R> bool Deferred<R>::ready() const {
+    return m_owner->is_done(*m_slot);
+  }
+
+  template <class R> R Deferred<R>::get() {
+    return m_process(m_owner->wait(*m_slot));
+  }
+} // namespace red1z
+
+#endif // RED1Z_AUTO_PIPELINE_H
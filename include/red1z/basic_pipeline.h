@@ -3,38 +3,110 @@
 #define RED1Z_BASIC_PIPELINE_H
 
 #include "red1z/interfaces.h"
+#include "red1z/result.h"
 
+#include <cstring>
+#include <exception>
+#include <new>
+#include <type_traits>
 #include <utility>
 
 namespace red1z {
   namespace impl {
-    template <class T> struct Resolver {
-      virtual ~Resolver() {}
-      virtual T resolve(Reply &&) = 0;
-    };
+    /// Type-erased resolvers of the queued commands, stored inline in one
+    /// contiguous block: commands are stateless, only the output parameter of
+    /// bound commands is kept, in a small buffer (or on the heap when it does
+    /// not fit or is not trivially copyable).
+    template <class T> class ResolverArena {
+      static constexpr std::size_t N = 3 * sizeof(void *);
 
-    template <class T, class Cmd> struct SimpleResolver : Resolver<T> {
-    protected:
-      impl::Command<Cmd> m_cmd;
+      struct Slot {
+        T (*resolve)(Slot &, Reply &&);
+        void (*destroy)(Slot &);
+        alignas(std::max_align_t) unsigned char storage[N];
+      };
+
+      std::vector<Slot> m_slots;
+
+      template <class Out>
+      static constexpr bool is_inline_v =
+          sizeof(Out) <= N && alignof(Out) <= alignof(std::max_align_t) &&
+          std::is_trivially_copyable_v<Out>;
 
     public:
-      SimpleResolver(impl::Command<Cmd> &&cmd) : m_cmd(std::move(cmd)) {}
-      T resolve(Reply &&r) override {
-        return m_cmd.process(std::move(r));
+      ResolverArena() = default;
+      ResolverArena(ResolverArena const &) = delete;
+      ResolverArena &operator=(ResolverArena const &) = delete;
+
+      ~ResolverArena() {
+        clear();
       }
-    };
 
-    template <class T, class Cmd, class Out>
-    class IntoResolver : public SimpleResolver<T, Cmd> {
-      Out m_out;
-      using Base = SimpleResolver<T, Cmd>;
+      template <class Cmd> void push() {
+        m_slots.push_back({&resolve_simple<Cmd>, nullptr, {}});
+      }
 
-    public:
-      IntoResolver(impl::Command<Cmd> &&cmd, Out out)
-          : Base(std::move(cmd)), m_out(out) {}
+      template <class Cmd, class Out> void push(Out out) {
+        auto &slot = m_slots.emplace_back();
+        slot.resolve = &resolve_into<Cmd, Out>;
+        slot.destroy = nullptr;
+        if constexpr (is_inline_v<Out>) {
+          new (slot.storage) Out(out);
+        } else {
+          auto const p = new Out(out);
+          std::memcpy(slot.storage, &p, sizeof(p));
+          slot.destroy = &destroy<Out>;
+        }
+      }
+
+      int size() const {
+        return m_slots.size();
+      }
+
+      T resolve(int i, Reply &&r) {
+        auto &slot = m_slots[i];
+        return slot.resolve(slot, std::move(r));
+      }
+
+      void clear() {
+        for (auto &slot : m_slots) {
+          if (slot.destroy) {
+            slot.destroy(slot);
+          }
+        }
+        m_slots.clear();
+      }
+
+    private:
+      template <class Out> static Out &out(Slot &slot) {
+        if constexpr (is_inline_v<Out>) {
+          return *std::launder(reinterpret_cast<Out *>(slot.storage));
+        } else {
+          Out *p;
+          std::memcpy(&p, slot.storage, sizeof(p));
+          return *p;
+        }
+      }
 
-      T resolve(Reply &&r) override {
-        return this->m_cmd.process_into(std::move(r), m_out);
+      template <class Out> static void destroy(Slot &slot) {
+        delete &out<Out>(slot);
+      }
+
+      template <class Cmd> static T resolve_simple(Slot &, Reply &&r) {
+        if constexpr (std::is_void_v<T>) {
+          Cmd::process(std::move(r));
+        } else {
+          return Cmd::process(std::move(r));
+        }
+      }
+
+      template <class Cmd, class Out>
+      static T resolve_into(Slot &slot, Reply &&r) {
+        if constexpr (std::is_void_v<T>) {
+          Cmd::process_into(std::move(r), out<Out>(slot));
+        } else {
+          return Cmd::process_into(std::move(r), out<Out>(slot));
+        }
       }
     };
 
@@ -42,45 +114,100 @@ namespace red1z {
     class BasicPipeline : public CommandInterface<BasicPipeline<T, Derived>> {
     protected:
       CommandQueue m_queue;
-      std::vector<std::unique_ptr<Resolver<T>>> m_resolvers;
+      ResolverArena<T> m_resolvers;
       bool m_resolved = false;
 
       void _discard() {};
 
     public:
-      BasicPipeline(Context &c) : m_queue(c.start_pipeline()) {}
+      BasicPipeline(Context &c, std::pmr::memory_resource *mr = nullptr)
+          : m_queue(c.start_pipeline(mr)) {}
 
       ~BasicPipeline() {
         if (!m_resolved) {
-          discard();
+          try {
+            discard();
+          } catch (Error const &) {
+          }
         }
       }
 
       template <class Cmd> Derived &_run(impl::Command<Cmd> &&cmd) {
         append(std::move(cmd).cmd());
-        m_resolvers.push_back(
-            std::make_unique<SimpleResolver<T, Cmd>>(std::move(cmd)));
+        m_resolvers.template push<Cmd>();
         return self();
       }
 
       template <class Cmd, class Out>
       Derived &_run_into(Command<Cmd> &&cmd, Out out) {
         append(std::move(cmd).cmd());
-        m_resolvers.push_back(
-            std::make_unique<IntoResolver<T, Cmd, Out>>(std::move(cmd), out));
+        m_resolvers.template push<Cmd>(out);
         return self();
       }
 
-      std::vector<T> execute() {
+      /// execute the queued commands, returns their results as a
+      /// std::vector<T>, or nothing for a Pipeline<void> whose results are
+      /// only delivered through bound outputs (no boxing into T at all).
+      /// Every reply is read even when a command fails, the first error is
+      /// then thrown
+      auto execute() {
+        if constexpr (std::is_void_v<T>) {
+          resolve_all([this](int index, Reply &&r) {
+            m_resolvers.resolve(index, std::move(r));
+          });
+        } else {
+          std::vector<T> result;
+          result.reserve(m_resolvers.size());
+          resolve_all([this, &result](int index, Reply &&r) {
+            result.push_back(m_resolvers.resolve(index, std::move(r)));
+          });
+          return result;
+        }
+      }
+
+      /// execute the queued commands, calling `visitor(index, result)` (or
+      /// `visitor(index)` for a Pipeline<void>) as soon as each reply is
+      /// read: results are never collected, combined with bound outputs the
+      /// memory used stays proportional to a single reply. The visitor is
+      /// not called anymore once a command failed
+      template <class Visitor> void execute(Visitor &&visitor) {
+        resolve_all([this, &visitor](int index, Reply &&r) {
+          if constexpr (std::is_void_v<T>) {
+            m_resolvers.resolve(index, std::move(r));
+            visitor(index);
+          } else {
+            visitor(index, m_resolvers.resolve(index, std::move(r)));
+          }
+        });
+      }
+
+      /// execute the queued commands without throwing for their errors:
+      /// returns a Result<T> per command, holding either its result or the
+      /// message of its error reply (or of the error raised decoding it)
+      std::vector<Result<T>> try_execute() {
         mark_resolved();
-        int const n = m_resolvers.size();
-        std::vector<T> result;
-        result.reserve(n);
-        auto resolver = [i = 0, this, &result](Reply &&r) mutable {
-          result.push_back(m_resolvers[i++]->resolve(std::move(r)));
+        std::vector<Result<T>> results;
+        results.reserve(m_resolvers.size());
+        DecodeScope scope(m_queue.decode_context());
+        auto resolver = [i = 0, this, &results](Reply &&r) mutable {
+          int const index = i++;
+          if (r.is_error()) {
+            results.push_back(Result<T>::failure(r.error()));
+            return;
+          }
+          try {
+            if constexpr (std::is_void_v<T>) {
+              m_resolvers.resolve(index, std::move(r));
+              results.emplace_back();
+            } else {
+              results.push_back(m_resolvers.resolve(index, std::move(r)));
+            }
+          } catch (std::exception const &e) {
+            results.push_back(Result<T>::failure(e.what()));
+          }
         };
-        self()._execute(n, resolver);
-        return result;
+        self()._execute(m_resolvers.size(), resolver);
+        return results;
       }
 
       void discard() {
@@ -106,6 +233,31 @@ namespace red1z {
         }
       }
 
+      /// pass every reply to f(index, reply) until one fails, the remaining
+      /// replies are still read then the first error is rethrown
+      template <class F> void resolve_all(F &&f) {
+        mark_resolved();
+        int const n = m_resolvers.size();
+        DecodeScope scope(m_queue.decode_context());
+        std::exception_ptr error;
+        auto resolver = [i = 0, &f, &error](Reply &&r) mutable {
+          int const index = i++;
+          if (error) {
+            return;
+          }
+          try {
+            r.check();
+            f(index, std::move(r));
+          } catch (...) {
+            error = std::current_exception();
+          }
+        };
+        self()._execute(n, resolver);
+        if (error) {
+          std::rethrow_exception(error);
+        }
+      }
+
       void append(std::string &&cmd) {
         check_unresolved();
         m_queue.append(std::move(cmd));
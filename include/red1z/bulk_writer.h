@@ -0,0 +1,272 @@
+// -*- C++ -*-
+#ifndef RED1Z_BULK_WRITER_H
+#define RED1Z_BULK_WRITER_H
+
+#include "red1z/command_table.h"
+#include "red1z/context.h"
+#include "red1z/depth_controller.h"
+#include "red1z/interfaces.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace red1z {
+  /// Full duplex ingestion: commands are encoded and written by the calling
+  /// thread while a reader thread concurrently reads and checks their
+  /// replies. The replies are not returned, error replies are counted and
+  /// reported by finish(), so commands replying data and the bound form are
+  /// rejected, see _run().
+  ///
+  /// Commands are buffered and written once `flush_size` bytes are queued,
+  /// at most `window` commands may be unacknowledged before the writer waits
+  /// for the reader. With an AdaptiveDepth, the window follows the measured
+  /// latency (see DepthController) and a write is also issued once a quarter
+  /// of the window is buffered.
+  ///
+  /// A BulkWriter borrows the connection of a red1z::Redis (see
+  /// Redis::bulk_writer()), which must not be used while the BulkWriter
+  /// lives.
+  class BulkWriter : public impl::CommandInterface<BulkWriter> {
+    impl::Socket &m_sock;
+    std::size_t const m_flush_size;
+    bool const m_adaptive;
+    std::string m_buffer;
+    std::uint64_t m_window;   // copy of m_depth.depth() for the writer
+    std::uint64_t m_flushed = 0;  // m_queued at the last flush
+
+    // both sides only ever increase their counter: the writer m_sent once
+    // commands are written, the reader m_received once replies are read
+    std::uint64_t m_queued = 0;
+    std::uint64_t m_finished = 0; // m_queued at the last finish()
+    std::atomic<std::uint64_t> m_sent{0};
+    std::atomic<std::uint64_t> m_received{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::uint64_t m_errors = 0;
+    std::uint64_t m_first_error_index = 0;
+    std::string m_first_error;
+    std::exception_ptr m_failure;
+
+    // latency of one command per write, measured by the reader:
+    // m_mark is the index + 1 of that command, 0 when none is measured
+    DepthController m_depth;
+    std::atomic<std::uint64_t> m_mark{0};
+    DepthController::clock::time_point m_mark_time;
+    bool m_mark_limited = false;
+
+    std::thread m_reader;
+
+  public:
+    BulkWriter(impl::Context &ctx, std::uint64_t window = 1 << 16,
+               std::size_t flush_size = 1 << 16)
+        : m_sock(ctx.socket()), m_flush_size(flush_size), m_adaptive(false),
+          m_window(window), m_depth(static_cast<int>(window)) {
+      start(ctx);
+    }
+
+    BulkWriter(impl::Context &ctx, AdaptiveDepth const &window,
+               std::size_t flush_size = 1 << 16)
+        : m_sock(ctx.socket()), m_flush_size(flush_size), m_adaptive(true),
+          m_depth(window) {
+      m_window = m_depth.depth();
+      start(ctx);
+    }
+
+    BulkWriter(BulkWriter const &) = delete;
+    BulkWriter &operator=(BulkWriter const &) = delete;
+
+    /// waits for the replies of every written command
+    ~BulkWriter() {
+      try {
+        flush();
+        wait_replies(m_queued);
+      } catch (...) {
+      }
+      {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      m_reader.join();
+    }
+
+    /// commands replying data are rejected: at compile time for most of
+    /// them, by name for those replying an integer or a string (e.g. TTL,
+    /// EXISTS, TYPE)
+    template <class Cmd> void _run(impl::Command<Cmd> &&cmd) {
+      static_assert(impl::has_report_reply_v<Cmd>,
+                    "the replies of a BulkWriter are not returned, it cannot "
+                    "run commands replying data");
+      auto const name = impl::command_name(cmd.cmd());
+      if (impl::is_read_only(name)) {
+        throw Error("the replies of a BulkWriter are not returned, it cannot "
+                    "run the read-only command ",
+                    name);
+      }
+      queue(std::move(cmd).cmd());
+    }
+
+    template <class Cmd, class Out>
+    void _run_into(impl::Command<Cmd> &&, Out) {
+      static_assert(impl::always_false_v<Out>,
+                    "the replies of a BulkWriter are not returned, it has no "
+                    "bound form");
+    }
+
+    /// write the buffered commands
+    void flush() {
+      if (m_buffer.empty()) {
+        return;
+      }
+      // bound the number of replies the server has to hold for us, the
+      // window may have shrunk below the buffered commands since they were
+      // queued: only written ones can be waited for
+      bool const limited = wait_replies(
+          std::min(m_flushed, m_queued > m_window ? m_queued - m_window : 0));
+      auto const start = DepthController::clock::now();
+      m_sock.write(m_buffer.data(), m_buffer.size());
+      m_buffer.clear();
+      m_flushed = m_queued;
+      {
+        std::lock_guard lock(m_mutex);
+        if (m_mark.load(std::memory_order_relaxed) == 0) {
+          m_mark_time = start;
+          m_mark_limited = limited;
+          m_mark.store(m_queued, std::memory_order_release);
+        }
+        m_window = m_depth.depth();
+        m_sent.store(m_queued, std::memory_order_release);
+      }
+      m_cv.notify_all();
+    }
+
+    /// flush and wait for every reply, returns the number of commands
+    /// written since the last call. Throws when some of them failed,
+    /// reporting the first error and the number of failed commands
+    std::uint64_t finish() {
+      flush();
+      wait_replies(m_queued);
+      std::lock_guard lock(m_mutex);
+      auto const errors = std::exchange(m_errors, 0);
+      auto const count = m_queued - std::exchange(m_finished, m_queued);
+      if (errors > 0) {
+        throw Error(errors, " of ", count, " bulk commands failed, command #",
+                    m_first_error_index, ": ", m_first_error);
+      }
+      return count;
+    }
+
+    /// number of commands written and not acknowledged yet
+    std::uint64_t in_flight() const {
+      return m_sent.load(std::memory_order_acquire) -
+             m_received.load(std::memory_order_acquire);
+    }
+
+    /// current window and latency measurements
+    PipelineMetrics metrics() {
+      std::lock_guard lock(m_mutex);
+      return m_depth.metrics();
+    }
+
+  private:
+    void start(impl::Context &ctx) {
+      if (not ctx.ready()) {
+        throw Error("cannot start bulk writer: requests are pending");
+      }
+      m_buffer.reserve(m_flush_size);
+      m_reader = std::thread([this] { read_loop(); });
+    }
+
+    void queue(std::string &&cmd) {
+      check_failure();
+      m_buffer += cmd;
+      ++m_queued;
+      // a whole window is written at once at most, so that the replies
+      // flush() waits for belong to commands already written
+      auto const unflushed = m_queued - m_flushed;
+      if (m_buffer.size() >= m_flush_size or unflushed >= m_window or
+          (m_adaptive and 4 * unflushed >= m_window)) {
+        flush();
+      }
+    }
+
+    void check_failure() {
+      std::lock_guard lock(m_mutex);
+      if (m_failure) {
+        std::rethrow_exception(m_failure);
+      }
+    }
+
+    /// wait until `n` replies have been read, returns whether it had to
+    bool wait_replies(std::uint64_t n) {
+      if (m_received.load(std::memory_order_acquire) >= n) {
+        return false;
+      }
+      std::unique_lock lock(m_mutex);
+      m_cv.wait(lock, [&] {
+        return m_failure or m_received.load(std::memory_order_acquire) >= n;
+      });
+      if (m_failure) {
+        std::rethrow_exception(m_failure);
+      }
+      return true;
+    }
+
+    void read_loop() {
+      std::uint64_t received = 0;
+      for (;;) {
+        std::uint64_t sent;
+        {
+          std::unique_lock lock(m_mutex);
+          m_cv.wait(lock, [&] {
+            return m_stop or m_sent.load(std::memory_order_acquire) > received;
+          });
+          sent = m_sent.load(std::memory_order_acquire);
+          if (sent == received) {
+            return; // stopped with nothing left to read
+          }
+        }
+        for (; received < sent; ++received) {
+          std::optional<std::string> error;
+          try {
+            error = impl::skip_reply(m_sock);
+          } catch (...) {
+            // a timeout, an I/O or protocol failure: nothing more is read
+            std::lock_guard lock(m_mutex);
+            m_failure = std::current_exception();
+            m_cv.notify_all();
+            return;
+          }
+          if (error) {
+            // an error reply, the following replies are still read
+            std::lock_guard lock(m_mutex);
+            if (m_errors++ == 0) {
+              m_first_error_index = received - m_finished;
+              m_first_error = std::move(*error);
+            }
+          }
+          m_received.store(received + 1, std::memory_order_release);
+          if (received + 1 == m_mark.load(std::memory_order_acquire)) {
+            std::lock_guard lock(m_mutex);
+            m_depth.on_command(DepthController::clock::now() - m_mark_time,
+                               m_mark_limited);
+            m_mark.store(0, std::memory_order_relaxed);
+          }
+        }
+        std::lock_guard lock(m_mutex);
+        m_cv.notify_all();
+      }
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_BULK_WRITER_H
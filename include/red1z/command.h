@@ -3,6 +3,8 @@
 #define RED1Z_COMMAND_H
 
 #include "args.h"
+#include "decode.h"
+#include "decode_pool.h"
 #include "error.h"
 #include "flags.h"
 #include "io.h"
@@ -11,12 +13,14 @@
 
 #include <array>
 #include <cstdlib>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 using namespace std::literals::string_literals;
@@ -63,6 +67,8 @@ namespace red1z {
       return nth_arg_impl<N, 0>(std::forward<Args>(args)...);
     }
 
+    template <class> constexpr bool always_false_v = false;
+
     struct auto_t {};
     template <class V, class T> struct auto_type { using type = V; };
     template <class T> struct auto_type<auto_t, T> { using type = T; };
@@ -194,6 +200,17 @@ namespace red1z {
       }
     };
 
+    /// whether the reply of `Cmd` only reports on the command (a status, a
+    /// count, a new value or id) rather than giving data read from the
+    /// server, which executors not returning replies cannot run
+    template <class Cmd>
+    constexpr bool has_report_reply_v =
+        std::is_same_v<Cmd, SimpleStringCommand> or
+        std::is_same_v<Cmd, StatusCommand> or
+        std::is_same_v<Cmd, IntegerCommand> or
+        std::is_same_v<Cmd, OptionalIntegerCommand> or
+        std::is_same_v<Cmd, FloatCommand>;
+
     template <class V>
     struct BulkStringCommand : Command<BulkStringCommand<V>> {
       using Command<BulkStringCommand<V>>::Command;
@@ -253,6 +270,53 @@ namespace red1z {
 
     template <class It> Reserver(It i, int n) -> Reserver<It>;
 
+    /// whether `Iterator` appends to a std::vector whose elements may be
+    /// written concurrently, i.e. not through a proxy into shared words as
+    /// for std::vector<bool>
+    template <class Iterator> struct is_vector_inserter : std::false_type {};
+
+    template <class T, class A>
+    struct is_vector_inserter<std::back_insert_iterator<std::vector<T, A>>>
+        : std::is_same<typename std::vector<T, A>::reference, T &> {};
+
+    template <class Iterator> struct Inserted : Iterator {
+      Inserted(Iterator i) : Iterator(i) {}
+
+      auto &target() {
+        return *this->container;
+      }
+    };
+
+    /// write decode(element) to `out` for each element, the elements are
+    /// decoded in parallel on the DecodePool of the connection when `out`
+    /// appends to a std::vector (other than std::vector<bool>) and the array
+    /// is large enough
+    template <class OutputIt, class Decode>
+    std::int64_t decode_elements(Array &elements, OutputIt out,
+                                 Decode decode) {
+      if constexpr (is_vector_inserter<OutputIt>::value) {
+        using T = typename OutputIt::container_type::value_type;
+        auto const &ctx = current_decode_context();
+        // interning tables are not thread safe
+        if constexpr (std::is_default_constructible_v<T>) {
+          if (ctx.pool and !ctx.names and
+              elements.size() >= ctx.pool->min_elements()) {
+            auto &c = Inserted(out).target();
+            auto const base = c.size();
+            c.resize(base + elements.size());
+            ctx.pool->parallel_for(elements.size(), [&](std::size_t i) {
+              c[base + i] = decode(elements[i]);
+            });
+            return elements.size();
+          }
+        }
+      }
+      for (auto &rr : elements) {
+        *out++ = decode(rr);
+      }
+      return elements.size();
+    }
+
     template <class V, class Derived, class Default>
     struct BasicArrayCommand : Command<BasicArrayCommand<V, Derived, Default>> {
       using Command<BasicArrayCommand<V, Derived, Default>>::Command;
@@ -307,11 +371,10 @@ namespace red1z {
 
       template <class U, class OutputIt>
       static std::int64_t process_into_impl(Reply &&r, OutputIt out) {
-        auto elements = std::move(r).array();
-        for (auto &rr : elements) {
-          *out++ = std::move(rr).get<U>();
-        }
-        return elements.size();
+        auto elements = std::move(r).elements();
+        return decode_elements(elements, out, [](Reply &rr) {
+          return std::move(rr).get<U>();
+        });
       }
     };
 
@@ -326,15 +389,13 @@ namespace red1z {
       template <class O, class OutputIt>
       static std::int64_t process_into_impl(Reply &&r, OutputIt out) {
         using U = remove_optional_t<O>;
-        auto elements = std::move(r).array();
-        for (auto &rr : elements) {
+        auto elements = std::move(r).elements();
+        return decode_elements(elements, out, [](Reply &rr) -> O {
           if (rr) {
-            *out++ = std::move(rr).get<U>();
-          } else {
-            *out++ = std::nullopt;
+            return std::move(rr).get<U>();
           }
-        }
-        return elements.size();
+          return std::nullopt;
+        });
       }
     };
 
@@ -352,15 +413,14 @@ namespace red1z {
       template <class V = void>
       static std::int64_t process_into(Reply &&r,
                                        std::tuple<std::optional<Ts>...> *out) {
-        auto elements = std::move(r).array(sizeof...(Ts));
+        auto elements = std::move(r).elements(sizeof...(Ts));
         *out = pack(elements, std::make_index_sequence<sizeof...(Ts)>());
         return sizeof...(Ts);
       }
 
     private:
       template <std::size_t... I>
-      static result_type pack(std::vector<Reply> &elements,
-                              std::index_sequence<I...>) {
+      static result_type pack(Array &elements, std::index_sequence<I...>) {
         return {get_opt<nth_element<I, Ts...>>(elements[I])...};
       }
 
@@ -411,13 +471,13 @@ namespace red1z {
       }
 
       static void process_into(Reply &&r, std::tuple<Ts...> *out) {
-        auto elements = std::move(r).array(sizeof...(Ts));
+        auto elements = std::move(r).elements(sizeof...(Ts));
         *out = pack(elements, std::make_index_sequence<sizeof...(Ts)>());
       }
 
     private:
       template <std::size_t... I>
-      static std::tuple<Ts...> pack(std::vector<Reply> &elements,
+      static std::tuple<Ts...> pack(Array &elements,
                                     std::index_sequence<I...>) {
         return std::make_tuple(
             std::move(elements[I]).get<nth_element<I, Ts...>>()...);
@@ -0,0 +1,204 @@
+// -*- C++ -*-
+#ifndef RED1Z_COMMAND_TABLE_H
+#define RED1Z_COMMAND_TABLE_H
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+namespace red1z {
+  namespace impl {
+    /// the `i`-th element of an encoded command, 0 being the command name
+    /// (empty when the command is shorter)
+    inline std::string_view command_part(std::string_view cmd, int i) {
+      auto skip_line = [&cmd] {
+        auto const eol = cmd.find("\r\n");
+        auto line = cmd.substr(0, eol);
+        cmd.remove_prefix(eol == cmd.npos ? cmd.size() : eol + 2);
+        return line;
+      };
+      auto bulk = [&]() -> std::string_view {
+        auto const header = skip_line();
+        if (header.size() < 2 or header.front() != '$') {
+          return {};
+        }
+        std::size_t n = 0;
+        for (auto c : header.substr(1)) {
+          n = 10 * n + (c - '0');
+        }
+        auto value = cmd.substr(0, n);
+        cmd.remove_prefix(std::min(cmd.size(), n + 2));
+        return value;
+      };
+      skip_line(); // *<count>
+      for (; i > 0; --i) {
+        bulk();
+      }
+      return bulk();
+    }
+
+    /// the number of elements of an encoded command, its name included
+    inline int command_size(std::string_view cmd) {
+      int n = 0;
+      if (not cmd.empty() and cmd.front() == '*') {
+        for (auto c : cmd.substr(1, cmd.find("\r\n") - 1)) {
+          n = 10 * n + (c - '0');
+        }
+      }
+      return n;
+    }
+
+    inline std::string_view command_name(std::string_view cmd) {
+      return command_part(cmd, 0);
+    }
+
+    /// the first argument of an encoded command, its key for most commands
+    /// (empty when the command has no argument)
+    inline std::string_view command_key(std::string_view cmd) {
+      return command_part(cmd, 1);
+    }
+
+    /// whether `name` is in `table` (sorted, upper case), ignoring case
+    template <std::size_t N>
+    bool in_command_table(std::string_view const (&table)[N],
+                          std::string_view name) {
+      char upper[32];
+      if (name.size() > sizeof(upper)) {
+        return false;
+      }
+      std::transform(name.begin(), name.end(), upper,
+                     [](unsigned char c) { return std::toupper(c); });
+      return std::binary_search(std::begin(table), std::end(table),
+                                std::string_view(upper, name.size()));
+    }
+
+    /// the first key of an encoded command, empty for the commands without
+    /// key: the first argument, except for the commands listed here
+    inline std::string_view command_first_key(std::string_view cmd) {
+      static constexpr std::string_view keyless[] = {
+          "CLIENT",   "CONFIG", "DBSIZE",  "ECHO",      "FLUSHALL", "FLUSHDB",
+          "INFO",     "KEYS",   "LASTSAVE", "PING",     "PUBLISH",  "RANDOMKEY",
+          "SCAN",     "SCRIPT", "TIME",    "WAIT"};
+      // <subcommand or operation> <key>
+      static constexpr std::string_view second[] = {"BITOP", "MEMORY",
+                                                    "OBJECT", "XGROUP",
+                                                    "XINFO"};
+      // <script> <numkeys> <key>...
+      static constexpr std::string_view script[] = {
+          "EVAL", "EVALSHA", "EVALSHA_RO", "EVAL_RO", "FCALL", "FCALL_RO"};
+      // <numkeys> <key>...
+      static constexpr std::string_view numkeys[] = {
+          "LMPOP", "SINTERCARD", "ZDIFF", "ZINTER", "ZINTERCARD", "ZMPOP",
+          "ZUNION"};
+      // [options] STREAMS <key>...
+      static constexpr std::string_view streams[] = {"XREAD", "XREADGROUP"};
+
+      auto const name = command_name(cmd);
+      auto key_after_count = [&cmd](int i) -> std::string_view {
+        auto const n = command_part(cmd, i);
+        if (n.empty() or n == "0") {
+          return {};
+        }
+        return command_part(cmd, i + 1);
+      };
+      if (in_command_table(keyless, name)) {
+        return {};
+      } else if (in_command_table(second, name)) {
+        return command_part(cmd, 2);
+      } else if (in_command_table(script, name)) {
+        return key_after_count(2);
+      } else if (in_command_table(numkeys, name)) {
+        return key_after_count(1);
+      } else if (in_command_table(streams, name)) {
+        for (int i = 1;; ++i) {
+          auto const part = command_part(cmd, i);
+          if (part.empty()) {
+            return {};
+          }
+          if (part.size() == 7 and
+              std::equal(part.begin(), part.end(), "STREAMS",
+                         [](unsigned char a, char b) {
+                           return std::toupper(a) == b;
+                         })) {
+            return command_part(cmd, i + 1);
+          }
+        }
+      }
+      return command_key(cmd);
+    }
+
+    /// commands which may be sent again when their reply was lost: running
+    /// them twice changes neither the data nor their reply. Writes replying
+    /// a count of what they changed (DEL, HSET, SADD, PFADD...) are left
+    /// out, the second run would report nothing changed
+    inline bool is_idempotent(std::string_view name) {
+      static constexpr std::string_view table[] = {
+          "BITCOUNT",  "BITPOS",    "DBSIZE",   "ECHO",      "EXISTS",
+          "EXPIRE",    "EXPIREAT",  "GEODIST",  "GEOHASH",   "GEOPOS",
+          "GET",       "GETBIT",    "GETRANGE", "HEXISTS",   "HGET",
+          "HGETALL",   "HKEYS",     "HLEN",     "HMGET",     "HMSET",
+          "HSCAN",     "HSTRLEN",   "HVALS",    "KEYS",      "LINDEX",
+          "LLEN",      "LRANGE",    "MGET",     "MSET",      "PEXPIRE",
+          "PEXPIREAT", "PFCOUNT",   "PING",     "PSETEX",    "PTTL",
+          "SCAN",      "SCARD",     "SDIFF",    "SET",       "SETEX",
+          "SINTER",    "SISMEMBER", "SMEMBERS", "SSCAN",     "STRLEN",
+          "SUNION",    "TTL",       "TYPE",     "XLEN",      "XRANGE",
+          "XREVRANGE", "ZCARD",     "ZCOUNT",   "ZRANGE",    "ZRANGEBYLEX",
+          "ZRANGEBYSCORE", "ZRANK", "ZREVRANGE", "ZREVRANGEBYSCORE",
+          "ZREVRANK",  "ZSCAN",     "ZSCORE"};
+      return in_command_table(table, name);
+    }
+
+    /// whether an encoded command may be sent again when its reply was lost:
+    /// an idempotent command, except for the conditional forms of SET and
+    /// EXPIRE (NX, GET, GT, LT) whose reply tells whether they applied,
+    /// which the second run would not
+    inline bool is_replayable(std::string_view cmd) {
+      static constexpr std::string_view set[] = {"SET"};
+      static constexpr std::string_view set_options[] = {"GET", "NX"};
+      static constexpr std::string_view expire[] = {"EXPIRE", "EXPIREAT",
+                                                    "PEXPIRE", "PEXPIREAT"};
+      static constexpr std::string_view expire_options[] = {"GT", "LT", "NX"};
+
+      auto const name = command_name(cmd);
+      if (not is_idempotent(name)) {
+        return false;
+      }
+      // the options follow <key> <value> or <key> <time>
+      auto has_option = [&cmd](auto const &options) {
+        auto const n = command_size(cmd);
+        for (int i = 3; i < n; ++i) {
+          if (in_command_table(options, command_part(cmd, i))) {
+            return true;
+          }
+        }
+        return false;
+      };
+      if (in_command_table(set, name)) {
+        return not has_option(set_options);
+      } else if (in_command_table(expire, name)) {
+        return not has_option(expire_options);
+      }
+      return true;
+    }
+
+    /// commands which only read data, and may then be served by a replica
+    inline bool is_read_only(std::string_view name) {
+      static constexpr std::string_view table[] = {
+          "BITCOUNT",  "BITPOS",   "DBSIZE",    "ECHO",        "EXISTS",
+          "GEODIST",   "GEOHASH",  "GEOPOS",    "GET",         "GETBIT",
+          "GETRANGE",  "HEXISTS",  "HGET",      "HGETALL",     "HKEYS",
+          "HLEN",      "HMGET",    "HSCAN",     "HSTRLEN",     "HVALS",
+          "KEYS",      "LINDEX",   "LLEN",      "LRANGE",      "MGET",
+          "PFCOUNT",   "PTTL",     "RANDOMKEY", "SCAN",        "SCARD",
+          "SDIFF",     "SINTER",   "SISMEMBER", "SMEMBERS",    "SRANDMEMBER",
+          "SSCAN",     "STRLEN",   "SUNION",    "TTL",         "TYPE",
+          "XLEN",      "XRANGE",   "XREVRANGE", "ZCARD",       "ZCOUNT",
+          "ZRANGE",    "ZRANGEBYLEX", "ZRANGEBYSCORE", "ZRANK", "ZREVRANGE",
+          "ZREVRANGEBYSCORE", "ZREVRANK", "ZSCAN", "ZSCORE"};
+      return in_command_table(table, name);
+    }
+  } // namespace impl
+} // namespace red1z
+
+#endif // RED1Z_COMMAND_TABLE_H
@@ -29,9 +29,9 @@ namespace red1z {
 
       template <class OutputIt>
       static std::uint64_t process_into(Reply &&r, OutputIt out) {
-        auto elements = std::move(r).array(2);
+        auto elements = std::move(r).elements(2);
         ArrayCommand<K>::process_into(std::move(elements[1]), out);
-        return atol(std::move(elements[0]).string().c_str());
+        return std::strtoull(elements[0].view().data(), nullptr, 10);
       }
     };
 
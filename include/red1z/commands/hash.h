@@ -1,7 +1,173 @@
 // -*- C++ -*-
+#ifndef RED1Z_COMMAND_HASH_H
+#define RED1Z_COMMAND_HASH_H
+
+#include <unordered_map>
+
+#include "red1z/schema.h"
 
 namespace red1z {
   namespace impl {
+    /// how field/value pairs are stored into a map-like container
+    template <class T, class Enable = void> struct hash_target {
+      using K = typename T::key_type;
+      using V = typename T::mapped_type;
+
+      static void clear(T &out) {
+        out.clear();
+      }
+
+      static void reserve(T &out, std::int64_t n) {
+        impl::reserve(out, n);
+      }
+
+      static void set(T &out, Reply &&field, Reply &&value) {
+        out.emplace(std::move(field).get<K>(), std::move(value).get<V>());
+      }
+    };
+
+    /// ... or into a struct described by red1z::schema<T>, whose members
+    /// missing from the hash are reset to their default value
+    template <class T>
+    struct hash_target<T, std::enable_if_t<has_schema_v<T>>> {
+      static void clear(T &out) {
+        out = T{};
+      }
+
+      static void reserve(T &, std::int64_t) {}
+
+      static void set(T &out, Reply &&field, Reply &&value) {
+        SchemaIndex<T>::get().set(out, field.view(), std::move(value));
+      }
+    };
+
+    /// loading a Tracked<T> leaves all its members clean
+    template <class T> struct hash_target<Tracked<T>> {
+      static void clear(Tracked<T> &out) {
+        hash_target<T>::clear(out.untracked());
+        out.mark_clean();
+      }
+
+      static void reserve(Tracked<T> &, std::int64_t) {}
+
+      static void set(Tracked<T> &out, Reply &&field, Reply &&value) {
+        hash_target<T>::set(out.untracked(), std::move(field),
+                            std::move(value));
+      }
+    };
+
+    /// call f(field, value) for each pair of a hash reply. Like the other
+    /// commands, the reply has already been framed into its elements by the
+    /// reader: the fields are not decoded from the socket as they arrive, so
+    /// a hash costs one Reply per field and per value before being loaded
+    template <class F> std::int64_t for_each_hash_field(Reply &&r, F &&f) {
+      auto elements = std::move(r).elements();
+      if (elements.size() % 2) {
+        throw Error("unexpected hash reply size");
+      }
+      for (std::size_t i = 0; i < elements.size(); i += 2) {
+        f(std::move(elements[i]), std::move(elements[i + 1]));
+      }
+      return elements.size() / 2;
+    }
+
+    template <class T> struct HashGetAllCommand : Command<HashGetAllCommand<T>> {
+      using Command<HashGetAllCommand<T>>::Command;
+
+      static T process(Reply &&r) {
+        T out;
+        process_into(std::move(r), &out);
+        return out;
+      }
+
+      template <class U> static std::int64_t process_into(Reply &&r, U *out) {
+        using Target = hash_target<U>;
+        Target::clear(*out);
+        Target::reserve(*out, r.array_size() / 2);
+        return for_each_hash_field(std::move(r), [out](Reply &&f, Reply &&v) {
+          Target::set(*out, std::move(f), std::move(v));
+        });
+      }
+
+      template <class OutputIt>
+      static std::int64_t process_into(Reply &&r, OutputIt out) {
+        using P = typename std::iterator_traits<OutputIt>::value_type;
+        return process_into_impl<P>(std::move(r), out);
+      }
+
+      template <class Container>
+      static std::int64_t
+      process_into(Reply &&r, std::back_insert_iterator<Container> out) {
+        Reserver(out, r.array_size() / 2);
+        return process_into_impl<typename Container::value_type>(std::move(r),
+                                                                 out);
+      }
+
+      template <class Container>
+      static std::int64_t process_into(Reply &&r,
+                                       std::insert_iterator<Container> out) {
+        return process_into_impl<typename Container::value_type>(std::move(r),
+                                                                 out);
+      }
+
+    private:
+      template <class P, class OutputIt>
+      static std::int64_t process_into_impl(Reply &&r, OutputIt out) {
+        using K = std::decay_t<std::tuple_element_t<0, P>>;
+        using V = std::decay_t<std::tuple_element_t<1, P>>;
+        return for_each_hash_field(std::move(r), [&out](Reply &&f, Reply &&v) {
+          *out++ = P(std::move(f).get<K>(), std::move(v).get<V>());
+        });
+      }
+    };
+
+    template <class T> struct HScanCommand : Command<HScanCommand<T>> {
+      using Base = Command<HScanCommand<T>>;
+
+      template <class K, class... Flags>
+      HScanCommand(K const &key, std::int64_t cursor, Flags const &... flags)
+          : Base("HSCAN",
+                 sig::signature<sig::arg<>, sig::arg<sig::_int>,
+                                sig::flag<flags::_match>,
+                                sig::flag<flags::_count>>(),
+                 key, cursor, flags...) {}
+
+      static std::tuple<std::uint64_t, T> process(Reply &&r) {
+        T out;
+        auto cursor = process_into(std::move(r), &out);
+        return {cursor, std::move(out)};
+      }
+
+      template <class Out>
+      static std::uint64_t process_into(Reply &&r, Out out) {
+        auto elements = std::move(r).elements(2);
+        HashGetAllCommand<T>::process_into(std::move(elements[1]), out);
+        return std::strtoull(elements[0].view().data(), nullptr, 10);
+      }
+    };
+
+    /// the fields of a Tracked<T> written by a TrackedHSetCommand, and its
+    /// generation when the command was queued
+    template <class T> struct TrackedFields {
+      Tracked<T> *obj;
+      std::bitset<SchemaIndex<T>::size> fields;
+      std::uint64_t generation;
+    };
+
+    /// HSET of the dirty fields of a Tracked<T>: the written fields are
+    /// bound as its output, and marked clean once its reply is read unless
+    /// modified meanwhile (e.g. before a pipeline is executed)
+    struct TrackedHSetCommand : Command<TrackedHSetCommand> {
+      using Command<TrackedHSetCommand>::Command;
+
+      template <class T>
+      static std::int64_t process_into(Reply &&r, TrackedFields<T> out) {
+        auto const n = r.integer();
+        out.obj->mark_clean(out.fields, out.generation);
+        return n;
+      }
+    };
+
     template <class Executor> class HashCommands {
       template <class Cmd> decltype(auto) run(Cmd &&cmd) {
         return static_cast<Executor *>(this)->_run(std::move(cmd));
@@ -24,20 +190,11 @@ namespace red1z {
         return run(BulkStringCommand<T>("HGET", key, field));
       }
 
-      // TODO
-      // template <class K=std::string, class V=std::string, class Key>
-      // std::map<K, V> hgetall(Key const& key) {
-      //   auto r = cmd("HGETALL", key);
-      //   auto items = r.array();
-      //   int const n = items.size() / 2;
-      //   std::map<K, V> out;
-
-      //   for (int i = 0; i < n; i += n) {
-      //     out.emplace(items[2*i].template as<K>().value(),
-      //     items[2*i+1].template as<V>().value());
-      //   }
-      //   return out;
-      // }
+      template <class T = std::unordered_map<std::string, std::string>,
+                class K>
+      decltype(auto) hgetall(K const &key) {
+        return run(HashGetAllCommand<T>("HGETALL", key));
+      }
 
       template <class K, class F>
       decltype(auto) hincrby(K const &key, F const &field,
@@ -90,6 +247,17 @@ namespace red1z {
         return run(IntegerCommand("HSET", s(), key, field_value_pairs...));
       }
 
+      /// HSET with the dirty fields of `obj` only, they are marked clean once
+      /// its reply is read
+      template <class K, class T>
+      decltype(auto) hset(K const &key, Tracked<T> &obj) {
+        TrackedFields<T> written{&obj, obj.dirty_fields(), obj.generation()};
+        return static_cast<Executor *>(this)->_run_into(
+            TrackedHSetCommand(typename TrackedHSetCommand::raw(),
+                               encode_dirty("HSET", key, obj)),
+            written);
+      }
+
       template <class K, class F, class V>
       decltype(auto) hsetnx(K const &key, F const &field, V const &value) {
         return run(IntegerCommand("HSETNX", key, field, value));
@@ -104,7 +272,14 @@ namespace red1z {
         return run(ArrayCommand<T>("HVALS", key));
       }
 
-      // HSCAN
+      template <class T = std::unordered_map<std::string, std::string>,
+                class K, class... Flags>
+      decltype(auto) hscan(K const &key, std::int64_t cursor,
+                           Flags const &... flags) {
+        return run(HScanCommand<T>(key, cursor, flags...));
+      }
     };
   } // namespace impl
 } // namespace red1z
+
+#endif
@@ -53,7 +53,7 @@ namespace red1z {
       template <class U, class OutputIt>
       static std::int64_t process_into_impl(Reply &&r, OutputIt out) {
         using W = std::tuple_element_t<0, U>;
-        auto elements = std::move(r).array();
+        auto elements = std::move(r).elements();
         for (auto i = elements.begin(), end = elements.end(); i != end;
              i += 2) {
           *out++ =
@@ -5,6 +5,7 @@
 #include <type_traits>
 #include <unordered_map>
 
+#include "red1z/intern.h"
 #include "red1z/signature.h"
 
 namespace red1z {
@@ -12,24 +13,29 @@ namespace red1z {
   namespace streams {
     using default_entry_type = std::unordered_map<std::string, std::string>;
 
+    /// entry with field names interned on the connection (see
+    /// Redis::intern_names()), repeated field names are stored only once
+    template <class T = std::string>
+    using interned_entry = std::vector<std::tuple<Name, T>>;
+
     template <class Entry> struct entry_type_traits {};
 
-    template <class T>
-    struct entry_type_traits<std::unordered_map<std::string, T>> {
-      using name_type = std::string;
+    template <class K, class T>
+    struct entry_type_traits<std::unordered_map<K, T>> {
+      using name_type = K;
       using value_type = T;
-      static void set_field(std::unordered_map<std::string, T> &entry,
-                            std::string name, T value) {
+      static void set_field(std::unordered_map<K, T> &entry, K name,
+                            T value) {
         entry.emplace(std::move(name), std::move(value));
       }
     };
 
-    template <class T>
-    struct entry_type_traits<std::vector<std::tuple<std::string, T>>> {
-      using name_type = std::string;
+    template <class K, class T>
+    struct entry_type_traits<std::vector<std::tuple<K, T>>> {
+      using name_type = K;
       using value_type = T;
-      static void set_field(std::vector<std::tuple<std::string, T>> &entry,
-                            std::string name, T value) {
+      static void set_field(std::vector<std::tuple<K, T>> &entry, K name,
+                            T value) {
         entry.emplace_back(std::move(name), std::move(value));
       }
     };
@@ -47,12 +53,12 @@ namespace red1z {
                                      std::vector<std::tuple<T, std::int64_t>>>;
 
       static void process_into(Reply &&r, result_type *out) {
-        auto elements = std::move(r).array(4);
-        auto c = std::move(elements[3]).array();
+        auto elements = std::move(r).elements(4);
+        auto c = std::move(elements[3]).elements();
         std::vector<std::tuple<std::string, std::int64_t>> cinfo;
         cinfo.reserve(c.size());
         for (auto &&cons : c) {
-          auto info = std::move(cons).array(2);
+          auto info = std::move(cons).elements(2);
           cinfo.emplace_back(std::move(info[0]).string(),
                              std::stoi(std::move(info[1]).string()));
         }
@@ -80,9 +86,9 @@ namespace red1z {
 
       template <class U, class OutputIt>
       static std::int64_t process_into_impl(Reply &&r, OutputIt out) {
-        auto elements = std::move(r).array();
+        auto elements = std::move(r).elements();
         for (auto &rr : elements) {
-          auto info = std::move(rr).array(4);
+          auto info = std::move(rr).elements(4);
           *out++ = std::make_tuple(std::move(info[0]).string(),
                                    std::move(info[1]).get<T>(),
                                    info[2].integer(), info[3].integer());
@@ -97,10 +103,10 @@ namespace red1z {
       using result_type = std::vector<std::tuple<std::string, EntryType>>;
 
       static void process_into(Reply &&r, result_type *out) {
-        auto elements = std::move(r).array();
+        auto elements = std::move(r).elements();
         for (auto &rr : elements) {
-          auto entry = std::move(rr).array(2);
-          auto fields = std::move(entry[1]).array();
+          auto entry = std::move(rr).elements(2);
+          auto fields = std::move(entry[1]).elements();
           if (fields.size() % 2) {
             throw Error("unexpected fields reply size");
           }
@@ -133,9 +139,9 @@ namespace red1z {
           std::string, typename StreamReadCommand<EntryType>::result_type>>;
 
       static void process_into(Reply &&r, result_type *out) {
-        auto elements = std::move(r).array();
+        auto elements = std::move(r).elements();
         for (auto &rr : elements) {
-          auto e = std::move(rr).array(2);
+          auto e = std::move(rr).elements(2);
           out->emplace_back(
               std::move(e[0]).string(),
               StreamReadCommand<EntryType>::process(std::move(e[1])));
@@ -179,7 +185,7 @@ namespace red1z {
                      typename StreamReadCommand<EntryType>::result_type>;
 
       static void process_into(Reply &&r, result_type *out) {
-        auto tup = std::move(r).array(2);
+        auto tup = std::move(r).elements(2);
         *out = std::make_tuple(
             std::move(tup[0]).string(),
             StreamReadCommand<EntryType>::process(std::move(tup[1])));
@@ -197,7 +203,7 @@ namespace red1z {
       using result_type = std::tuple<std::string, std::vector<std::string>>;
 
       static void process_into(Reply &&r, result_type *out) {
-        auto tup = std::move(r).array(2);
+        auto tup = std::move(r).elements(2);
         *out = std::make_tuple(
             std::move(tup[0]).string(),
             ArrayCommand<std::string>::process(std::move(tup[1])));
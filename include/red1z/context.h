@@ -2,33 +2,97 @@
 #ifndef RED1Z_CONTEXT_H
 #define RED1Z_CONTEXT_H
 #include "red1z/command.h"
+#include "red1z/intern.h"
 #include "red1z/socket.h"
 
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <thread>
+
 namespace red1z {
   namespace impl {
     class Context;
 
     class CommandQueue {
       Context *m_ctx;
+      std::pmr::memory_resource *m_resource;
 
     public:
-      CommandQueue(Context *ctx) : m_ctx(ctx) {}
+      CommandQueue(Context *ctx, std::pmr::memory_resource *mr = nullptr)
+          : m_ctx(ctx), m_resource(mr) {}
+
+      CommandQueue(CommandQueue const &) = delete;
+      CommandQueue &operator=(CommandQueue const &) = delete;
+
+      // a moved-from queue is detached from its context
+      CommandQueue(CommandQueue &&other)
+          : m_ctx(std::exchange(other.m_ctx, nullptr)),
+            m_resource(other.m_resource) {}
+
+      bool attached() const {
+        return m_ctx != nullptr;
+      }
 
       inline int append(std::string &&cmd);
+      inline void flush();
       inline void discard(int count);
       inline void discard();
       inline Reply get_reply();
+      inline Reply get_reply_or_error();
+      inline DecodeContext decode_context() const;
       inline ~CommandQueue();
     };
 
+    /// A connection and its requests in flight.
+    ///
+    /// With Options::reconnect enabled, the commands are kept until their
+    /// reply is read. When the connection is lost, it is re-established (and
+    /// its handshake replayed), then the unacknowledged commands are sent
+    /// again up to the first one which may not be replayed: that one and the
+    /// following ones get an error reply instead, kept in order as empty
+    /// commands which are not sent.
     class Context {
       Socket m_sock;
       int m_in_flight = 0;
       std::vector<std::string> m_queue;
+      std::deque<std::string> m_sent; // unacknowledged, with reconnection
+      std::vector<std::string> m_handshake;
+      std::unique_ptr<Interner> m_names;
+      std::pmr::memory_resource *m_resource = nullptr;
+      DecodePool *m_pool = nullptr;
       friend class CommandQueue;
 
     public:
-      Context(std::string const &host, int port) : m_sock(host, port) {}
+      Context(std::string const &host, int port,
+              Options const &options = Options())
+          : m_sock(host, port, options) {}
+
+      /// add a connection setup command (AUTH, SELECT...), see handshake()
+      template <class... Args> void add_handshake(Args const &... cmd) {
+        m_handshake.push_back(encode_command(cmd...));
+      }
+
+      /// run the setup commands in a single round trip, on a new connection
+      /// (again after each reconnection); throws the first error once every
+      /// reply is read
+      void handshake() {
+        if (m_handshake.empty()) {
+          return;
+        }
+        m_sock.write_many(m_handshake);
+        std::optional<std::string> error;
+        for (std::size_t i = 0; i < m_handshake.size(); ++i) {
+          auto e = skip_reply(m_sock);
+          if (e and !error) {
+            error = std::move(e);
+          }
+        }
+        if (error) {
+          throw Error(*error);
+        }
+      }
 
       int in_flight() const {
         return m_in_flight;
@@ -38,13 +102,59 @@ namespace red1z {
         return m_in_flight == 0;
       }
 
+      /// replies are allocated from `mr` (when not null) instead of the
+      /// global allocator
+      void set_memory_resource(std::pmr::memory_resource *mr) {
+        m_resource = mr;
+      }
+
+      std::pmr::memory_resource *memory_resource() const {
+        return m_resource;
+      }
+
+      /// large array replies are decoded by the workers of `pool` (when not
+      /// null)
+      void set_decode_pool(DecodePool *pool) {
+        m_pool = pool;
+      }
+
+      /// socket operations after `deadline` throw red1z::Timeout
+      void set_deadline(Socket::clock::time_point deadline) {
+        m_sock.set_deadline(deadline);
+      }
+
+      Socket::clock::time_point deadline() const {
+        return m_sock.deadline();
+      }
+
+      /// abort the operations in progress, from any thread: the connection
+      /// is unusable afterwards
+      void cancel() {
+        m_sock.cancel();
+      }
+
       Reply get_reply() {
+        return get_reply(m_resource);
+      }
+
+      /// the next reply, throws (once it is fully read) for an error reply
+      Reply get_reply(std::pmr::memory_resource *mr) {
+        auto r = get_reply_or_error(mr);
+        r.check();
+        return r;
+      }
+
+      /// the next reply, error replies included (see Reply::is_error())
+      Reply get_reply_or_error(std::pmr::memory_resource *mr) {
         if (m_in_flight == 0) {
           throw Error("cannot get reply: no requests in flight");
         }
         --m_in_flight;
-        send();
-        return {m_sock};
+        if (not tracking()) {
+          send();
+          return {m_sock, mr};
+        }
+        return acknowledge([&] { return Reply(m_sock, mr); });
       }
 
       Reply get_message() {
@@ -59,12 +169,19 @@ namespace red1z {
       }
 
       Reply execute(std::string &&cmd) {
+        auto r = execute_or_error(std::move(cmd));
+        r.check();
+        return r;
+      };
+
+      Reply execute_or_error(std::string &&cmd) {
         if (not ready()) {
           throw Error("cannot execute command: requests are pending");
         }
+        revive();
         append(std::move(cmd));
-        return get_reply();
-      };
+        return get_reply_or_error(m_resource);
+      }
 
       template <class... Args> Reply run(Args const &... cmd) {
         return execute(encode_command(cmd...));
@@ -75,12 +192,38 @@ namespace red1z {
         m_sock.write(c.data(), c.size());
       }
 
-      CommandQueue start_pipeline() {
+      /// the socket file descriptor, e.g. to watch it from an event loop
+      int fd() const {
+        return m_sock;
+      }
+
+      /// direct access to the connection, for executors tracking their
+      /// replies on their own (the context must be ready)
+      Socket &socket() {
+        return m_sock;
+      }
+
+      /// the name interning table of this connection, created on first use
+      Interner &names() {
+        if (!m_names) {
+          m_names = std::make_unique<Interner>();
+        }
+        return *m_names;
+      }
+
+      DecodeContext decode_context() const {
+        return {m_names.get(), m_pool};
+      }
+
+      /// start a pipeline, its replies are allocated from `mr`, or from the
+      /// resource of the context when null
+      CommandQueue start_pipeline(std::pmr::memory_resource *mr = nullptr) {
         if (not ready()) {
           throw Error("cannot start pipeline: ", m_in_flight,
                       " requests are pending");
         }
-        return {this};
+        revive();
+        return {this, mr ? mr : m_resource};
       }
 
     private:
@@ -90,26 +233,152 @@ namespace red1z {
       }
 
       void discard_reply() {
-        get_reply();
+        if (m_in_flight == 0) {
+          throw Error("cannot discard reply: no requests in flight");
+        }
+        --m_in_flight;
+        if (not tracking()) {
+          send();
+          if (auto error = skip_reply(m_sock)) {
+            throw Error(*error);
+          }
+          return;
+        }
+        acknowledge([this] {
+          if (auto error = skip_reply(m_sock)) {
+            return Reply(Rep(ErrorReply{std::move(*error)}));
+          }
+          return Reply(Rep(std::nullopt));
+        }).check();
       }
 
       void send() {
         m_sock.write_many(m_queue);
+        if (tracking()) {
+          std::move(m_queue.begin(), m_queue.end(), std::back_inserter(m_sent));
+        }
         m_queue.clear();
       }
+
+      bool tracking() const {
+        return m_sock.options().reconnect.max_attempts > 0;
+      }
+
+      /// read the reply of the oldest unacknowledged command with `read`,
+      /// recovering from the loss of the connection
+      template <class Read> Reply acknowledge(Read const &read) {
+        for (;;) {
+          try {
+            send();
+            if (m_sent.front().empty()) {
+              m_sent.pop_front();
+              return Reply(Rep(ErrorReply{
+                  "connection lost, the command was not replayed"}));
+            }
+            auto r = read();
+            m_sent.pop_front();
+            return r;
+          } catch (Error const &) {
+            if (recover()) {
+              continue;
+            }
+            if (not m_sock.broken()) {
+              m_sent.pop_front(); // the reply was consumed
+            }
+            throw;
+          }
+        }
+      }
+
+      /// reconnect after the connection was lost, then queue the
+      /// unacknowledged commands again
+      bool recover() {
+        if (not tracking() or not m_sock.connection_lost()) {
+          return false;
+        }
+        reconnect();
+        auto const &replayable = m_sock.options().reconnect.replayable;
+        std::vector<std::string> queue;
+        queue.reserve(m_sent.size() + m_queue.size());
+        bool replaying = true;
+        auto requeue = [&](std::string &&cmd) {
+          replaying = replaying and not cmd.empty() and replayable and
+                      replayable(cmd);
+          queue.push_back(replaying ? std::move(cmd) : std::string());
+        };
+        for (auto &c : m_sent) {
+          requeue(std::move(c));
+        }
+        for (auto &c : m_queue) {
+          requeue(std::move(c));
+        }
+        m_sent.clear();
+        m_queue = std::move(queue);
+        return true;
+      }
+
+      /// reconnect a connection left unusable (e.g. by a timeout) before
+      /// new requests, when reconnection is enabled
+      void revive() {
+        if (tracking() and m_sock.broken()) {
+          m_sent.clear();
+          m_queue.clear();
+          reconnect();
+        }
+      }
+
+      /// connect again with exponential backoff and full jitter, and run
+      /// the handshake
+      void reconnect() {
+        auto const &policy = m_sock.options().reconnect;
+        thread_local std::minstd_rand rng(std::random_device{}());
+        for (int attempt = 0;; ++attempt) {
+          auto const cap = std::min<std::int64_t>(
+              policy.max_backoff.count(),
+              policy.initial_backoff.count() << std::min(attempt, 20));
+          std::uniform_int_distribution<std::int64_t> delay(0, cap);
+          std::this_thread::sleep_for(std::chrono::milliseconds(delay(rng)));
+          try {
+            m_sock.reconnect();
+            handshake();
+            return;
+          } catch (Error const &) {
+            if (attempt + 1 >= policy.max_attempts) {
+              m_sock.poison("unable to reconnect");
+              throw;
+            }
+          }
+        }
+      }
     };
 
     int CommandQueue::append(std::string &&cmd) {
       return m_ctx->append(std::move(cmd));
     }
 
+    /// write the appended commands without reading their replies
+    void CommandQueue::flush() {
+      m_ctx->send();
+    }
+
     void CommandQueue::discard(int count) {
       if (int n = m_ctx->in_flight(); n < count) {
         throw Error("cannot discard ", count, " replies: there are only ", n,
                     " requests in flight");
       }
+      // every reply is consumed before reporting the first error reply
+      std::optional<Error> error;
       for (int i = 0; i < count; ++i) {
-        m_ctx->discard_reply();
+        try {
+          m_ctx->discard_reply();
+        } catch (Error const &e) {
+          if (!error) {
+            error = e;
+          }
+        }
+      }
+      if (error) {
+        throw *error;
       }
     }
     void CommandQueue::discard() {
@@ -117,11 +386,25 @@ namespace red1z {
     }
 
     Reply CommandQueue::get_reply() {
-      return m_ctx->get_reply();
+      return m_ctx->get_reply(m_resource);
+    }
+
+    Reply CommandQueue::get_reply_or_error() {
+      return m_ctx->get_reply_or_error(m_resource);
+    }
+
+    DecodeContext CommandQueue::decode_context() const {
+      return m_ctx->decode_context();
     }
 
     CommandQueue::~CommandQueue() {
-      discard();
+      if (m_ctx) {
+        try {
+          discard();
+        } catch (Error const &) {
+          // error replies of abandoned commands
+        }
+      }
     }
   } // namespace impl
 } // namespace red1z
@@ -0,0 +1,279 @@
+// -*- C++ -*-
+#ifndef RED1Z_CORO_H
+#define RED1Z_CORO_H
+
+#if __cplusplus < 202002L
+#error "red1z/coro.h requires C++20, build with RED1Z_COROUTINES=ON"
+#endif
+
+#include "red1z/async.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace red1z {
+  namespace coro {
+    template <class T = void> class Task;
+
+    namespace impl {
+      template <class T> struct TaskResult {
+        std::optional<T> m_value;
+
+        template <class U> void return_value(U &&v) {
+          m_value.emplace(std::forward<U>(v));
+        }
+
+        T result() {
+          return std::move(*m_value);
+        }
+      };
+
+      template <> struct TaskResult<void> {
+        void return_void() {}
+        void result() {}
+      };
+    } // namespace impl
+
+    /// A lazily started coroutine returning T, resumed by the reactor when
+    /// the commands it awaits get their replies. Tasks are awaited by other
+    /// tasks or started with Reactor::spawn().
+    template <class T> class Task {
+    public:
+      struct promise_type : impl::TaskResult<T> {
+        std::coroutine_handle<> m_continuation;
+        std::exception_ptr m_error;
+
+        Task get_return_object() {
+          return Task(handle::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+          return {};
+        }
+
+        auto final_suspend() noexcept {
+          struct Final {
+            bool await_ready() noexcept {
+              return false;
+            }
+
+            std::coroutine_handle<>
+            await_suspend(handle h) noexcept {
+              if (auto c = h.promise().m_continuation) {
+                return c;
+              }
+              return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+          };
+          return Final{};
+        }
+
+        void unhandled_exception() {
+          m_error = std::current_exception();
+        }
+      };
+
+      using handle = std::coroutine_handle<promise_type>;
+
+      Task(Task &&other) : m_handle(std::exchange(other.m_handle, nullptr)) {}
+      Task(Task const &) = delete;
+
+      ~Task() {
+        if (m_handle) {
+          m_handle.destroy();
+        }
+      }
+
+      bool await_ready() const noexcept {
+        return false;
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+        m_handle.promise().m_continuation = caller;
+        return m_handle;
+      }
+
+      T await_resume() {
+        auto &p = m_handle.promise();
+        if (p.m_error) {
+          std::rethrow_exception(p.m_error);
+        }
+        return p.result();
+      }
+
+    private:
+      handle m_handle;
+
+      explicit Task(handle h) : m_handle(h) {}
+    };
+
+    /// receives the epoll events of a registered file descriptor
+    struct Handler {
+      virtual void on_events(std::uint32_t events) = 0;
+
+    protected:
+      ~Handler() = default;
+    };
+
+    /// A minimal epoll event loop driving the connections created on it and
+    /// the tasks spawned on it, from a single thread.
+    class Reactor {
+      int m_epoll;
+      int m_tasks = 0;
+      std::exception_ptr m_error;
+      std::vector<std::function<void()>> m_posted;
+      // the handlers of the events being dispatched, reset by remove()
+      Handler **m_batch = nullptr;
+      int m_batch_size = 0;
+
+    public:
+      Reactor();
+      ~Reactor();
+      Reactor(Reactor const &) = delete;
+      Reactor &operator=(Reactor const &) = delete;
+
+      void add(int fd, std::uint32_t events, Handler *h);
+      void modify(int fd, std::uint32_t events, Handler *h);
+      /// deregister `h`, which gets none of the events still to be
+      /// dispatched, and may then be destroyed from a handler
+      void remove(int fd, Handler *h);
+
+      /// call `f` from run_once(), once the ready events are dispatched
+      void post(std::function<void()> f) {
+        m_posted.push_back(std::move(f));
+      }
+
+      /// start `task`, it runs until its first suspension point
+      void spawn(Task<> task);
+
+      /// dispatch events until every spawned task completed, rethrows the
+      /// first exception escaping a spawned task
+      void run();
+
+      /// dispatch the events ready within `timeout` ms (-1 to block, no
+      /// wait when calls are posted) then the posted calls, returns false
+      /// when no task is left
+      bool run_once(int timeout = -1);
+
+    private:
+      struct Detached;
+      static Detached detach(Reactor &r, Task<> task);
+    };
+
+    class Redis;
+
+    namespace impl {
+      /// resumes the awaiting task once the reply is read
+      struct Waiter final : red1z::impl::Completion {
+        std::coroutine_handle<> m_handle;
+        std::optional<Reply> m_reply;
+        std::exception_ptr m_error;
+
+        void complete(Reply &&r) override {
+          m_reply.emplace(std::move(r));
+          m_handle.resume();
+        }
+
+        void fail(std::exception_ptr e) override {
+          m_error = e;
+          m_handle.resume();
+        }
+      };
+
+      template <class Cmd, class Out> class CommandAwaiter;
+    } // namespace impl
+
+    /// A connection whose commands are awaited from a Task instead of
+    /// blocking: `auto v = co_await r.get<int>(k);`. Commands awaited
+    /// concurrently by different tasks are pipelined on the connection.
+    class Redis : public red1z::impl::CommandInterface<Redis>, Handler {
+      Reactor &m_reactor;
+      red1z::impl::AsyncContext m_ctx;
+
+      template <class, class> friend class impl::CommandAwaiter;
+
+    public:
+      /// connects (and authenticates) synchronously, then registers the
+      /// connection on `reactor`
+      Redis(Reactor &reactor, std::string const &hostname, int port = 6379,
+            int db = 0, std::optional<std::string> pass = std::nullopt);
+      /// the tasks still awaiting a reply are resumed with an error by the
+      /// reactor, after the destruction
+      ~Redis();
+
+      Redis(Redis const &) = delete;
+      Redis &operator=(Redis const &) = delete;
+
+      /// number of commands waiting for their reply
+      std::size_t in_flight() const {
+        return m_ctx.in_flight();
+      }
+
+      template <class Cmd> auto _run(red1z::impl::Command<Cmd> &&cmd) {
+        return impl::CommandAwaiter<Cmd, void>(*this, std::move(cmd));
+      }
+
+      template <class Cmd, class Out>
+      auto _run_into(red1z::impl::Command<Cmd> &&cmd, Out out) {
+        return impl::CommandAwaiter<Cmd, Out>(*this, std::move(cmd), out);
+      }
+
+      void on_events(std::uint32_t events) override;
+
+    };
+
+    namespace impl {
+      template <class Out> struct AwaiterOut { Out m_out; };
+      template <> struct AwaiterOut<void> {};
+
+      /// suspends the awaiting task until the reply of `cmd` is read
+      template <class Cmd, class Out>
+      class CommandAwaiter : AwaiterOut<Out> {
+        Redis &m_redis;
+        Cmd m_cmd;
+        Waiter m_waiter;
+
+      public:
+        CommandAwaiter(Redis &r, red1z::impl::Command<Cmd> &&cmd)
+            : m_redis(r), m_cmd(static_cast<Cmd &&>(cmd)) {}
+
+        template <class O>
+        CommandAwaiter(Redis &r, red1z::impl::Command<Cmd> &&cmd, O out)
+            : AwaiterOut<Out>{out}, m_redis(r),
+              m_cmd(static_cast<Cmd &&>(cmd)) {}
+
+        bool await_ready() const noexcept {
+          return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+          m_waiter.m_handle = h;
+          m_redis.m_ctx.submit(std::move(m_cmd).cmd(), &m_waiter);
+        }
+
+        decltype(auto) await_resume() {
+          if (m_waiter.m_error) {
+            std::rethrow_exception(m_waiter.m_error);
+          }
+          red1z::impl::DecodeScope scope(m_redis.m_ctx.decode_context());
+          if constexpr (std::is_void_v<Out>) {
+            return m_cmd.process(std::move(*m_waiter.m_reply));
+          } else {
+            return m_cmd.process_into(std::move(*m_waiter.m_reply),
+                                      this->m_out);
+          }
+        }
+      };
+    } // namespace impl
+  } // namespace coro
+} // namespace red1z
+
+#endif // RED1Z_CORO_H
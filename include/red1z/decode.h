@@ -0,0 +1,42 @@
+// -*- C++ -*-
+#ifndef RED1Z_DECODE_H
+#define RED1Z_DECODE_H
+
+#include <utility>
+
+namespace red1z {
+  class Interner;
+  class DecodePool;
+
+  namespace impl {
+    /// per-connection state made available to io<T>::read while the replies
+    /// of that connection are being processed
+    struct DecodeContext {
+      Interner *names = nullptr;
+      DecodePool *pool = nullptr;
+    };
+
+    inline thread_local DecodeContext decode_context;
+
+    inline DecodeContext const &current_decode_context() {
+      return decode_context;
+    }
+
+    class DecodeScope {
+      DecodeContext m_saved;
+
+    public:
+      explicit DecodeScope(DecodeContext const &ctx)
+          : m_saved(std::exchange(decode_context, ctx)) {}
+
+      DecodeScope(DecodeScope const &) = delete;
+      DecodeScope &operator=(DecodeScope const &) = delete;
+
+      ~DecodeScope() {
+        decode_context = m_saved;
+      }
+    };
+  } // namespace impl
+} // namespace red1z
+
+#endif // RED1Z_DECODE_H
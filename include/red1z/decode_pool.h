@@ -0,0 +1,94 @@
+// -*- C++ -*-
+#ifndef RED1Z_DECODE_POOL_H
+#define RED1Z_DECODE_POOL_H
+
+#include "red1z/decode.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace red1z {
+  /// Worker threads decoding the elements of large array replies: once set
+  /// on a connection (Redis::set_decode_pool()), the io<T>::read calls of
+  /// array replies of at least `min_elements` elements read into a
+  /// std::vector are split between the workers and the calling thread.
+  /// A pool may be shared by several connections, their replies are then
+  /// decoded one at a time.
+  class DecodePool {
+    using Fn = void (*)(void *ctx, std::size_t begin, std::size_t end);
+
+    struct Job {
+      Fn fn = nullptr;
+      void *ctx = nullptr;
+      std::size_t size = 0;
+      std::size_t grain = 1;
+      std::size_t next = 0;
+      std::size_t running = 0;
+      std::exception_ptr error;
+      // of the submitting thread, e.g. its connection's interner
+      impl::DecodeContext context;
+    };
+
+    std::size_t m_min_elements;
+    std::vector<std::thread> m_workers;
+    std::mutex m_submit; // one job at a time
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_done;
+    Job m_job;
+    std::size_t m_generation = 0;
+    bool m_stop = false;
+
+  public:
+    /// `threads` workers, besides the thread waiting for the reply
+    explicit DecodePool(unsigned threads = default_threads(),
+                        std::size_t min_elements = 4096);
+    ~DecodePool();
+
+    DecodePool(DecodePool const &) = delete;
+    DecodePool &operator=(DecodePool const &) = delete;
+
+    std::size_t min_elements() const {
+      return m_min_elements;
+    }
+
+    std::size_t threads() const {
+      return m_workers.size();
+    }
+
+    /// call f(i) for every i in [0, n), from the workers and the calling
+    /// thread, within the decode context of the calling thread (without its
+    /// pool: nested arrays are not split again); rethrows the first
+    /// exception raised by f
+    template <class F> void parallel_for(std::size_t n, F &&f) {
+      run(
+          n,
+          [](void *ctx, std::size_t begin, std::size_t end) {
+            auto &fn = *static_cast<std::remove_reference_t<F> *>(ctx);
+            for (auto i = begin; i < end; ++i) {
+              fn(i);
+            }
+          },
+          &f);
+    }
+
+    static unsigned default_threads() {
+      auto const n = std::thread::hardware_concurrency();
+      return n > 1 ? n - 1 : 1;
+    }
+
+  private:
+    void run(std::size_t n, Fn fn, void *ctx);
+    void work();
+    /// run chunks of the current job until none is left, called with the
+    /// lock held
+    void take_chunks(std::unique_lock<std::mutex> &lock);
+  };
+} // namespace red1z
+
+#endif // RED1Z_DECODE_POOL_H
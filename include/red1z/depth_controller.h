@@ -0,0 +1,122 @@
+// -*- C++ -*-
+#ifndef RED1Z_DEPTH_CONTROLLER_H
+#define RED1Z_DEPTH_CONTROLLER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+namespace red1z {
+  /// settings of the adaptive pipelining depth, see DepthController
+  struct AdaptiveDepth {
+    int initial = 64;
+    int min = 1;
+    int max = 1 << 16;
+    /// latency accepted for a batch (or a command in flight), as a multiple
+    /// of the smallest round trip time observed
+    double latency_factor = 4.0;
+  };
+
+  /// measurements of a pipelining executor
+  struct PipelineMetrics {
+    using duration = std::chrono::nanoseconds;
+
+    int depth;             // current limit on the commands in flight
+    duration min_rtt;      // smallest recent round trip time
+    duration rtt;          // smoothed round trip time
+    duration latency;      // smoothed latency of a batch, or of a command
+    duration service_time; // smoothed server time per command
+    std::uint64_t samples; // number of measurements
+  };
+
+  /// AIMD control of the number of commands in flight: the depth grows by
+  /// a fraction of itself while the measured latency stays within
+  /// latency_factor round trips (and the depth was actually reached), and is
+  /// halved once it exceeds it. The minimum round trip time is re-measured
+  /// every 256 samples to follow changes of the network path.
+  class DepthController {
+  public:
+    using clock = std::chrono::steady_clock;
+    using duration = PipelineMetrics::duration;
+
+  private:
+    AdaptiveDepth m_settings;
+    bool m_adaptive;
+    int m_depth;
+    duration m_min_rtt = duration::max();
+    duration m_next_min_rtt = duration::max();
+    duration m_rtt{0};
+    duration m_latency{0};
+    duration m_service{0};
+    std::uint64_t m_samples = 0;
+
+  public:
+    /// a fixed depth, only measured
+    explicit DepthController(int depth)
+        : m_settings{depth, depth, depth, 4.0}, m_adaptive(false),
+          m_depth(depth) {}
+
+    explicit DepthController(AdaptiveDepth const &settings)
+        : m_settings(settings), m_adaptive(true),
+          m_depth(std::clamp(settings.initial, settings.min, settings.max)) {}
+
+    int depth() const {
+      return m_depth;
+    }
+
+    /// a batch of `n` commands written at once: its first reply came after
+    /// `rtt`, its last one after `latency`. `limited` tells whether more
+    /// commands were waiting, i.e. the depth was the limit
+    void on_batch(int n, duration rtt, duration latency, bool limited) {
+      if (n > 1) {
+        smooth(m_service, (latency - rtt) / (n - 1));
+      }
+      on_sample(rtt, latency, limited);
+    }
+
+    /// the reply of a command came `latency` after it was written, `limited`
+    /// tells whether the writer had to wait for the depth
+    void on_command(duration latency, bool limited) {
+      on_sample(latency, latency, limited);
+    }
+
+    PipelineMetrics metrics() const {
+      return {m_depth,
+              m_min_rtt == duration::max() ? duration{0} : m_min_rtt,
+              m_rtt,
+              m_latency,
+              m_service,
+              m_samples};
+    }
+
+  private:
+    void on_sample(duration rtt, duration latency, bool limited) {
+      // windowed minimum: the next window's minimum is tracked meanwhile
+      m_next_min_rtt = std::min(m_next_min_rtt, rtt);
+      m_min_rtt = std::min(m_min_rtt, rtt);
+      smooth(m_rtt, rtt);
+      smooth(m_latency, latency);
+      if (++m_samples % 256 == 0) {
+        m_min_rtt = std::exchange(m_next_min_rtt, duration::max());
+      }
+      if (not m_adaptive) {
+        return;
+      }
+      auto const budget = std::chrono::duration_cast<duration>(
+          m_min_rtt * m_settings.latency_factor);
+      if (latency > budget) {
+        m_depth = std::max(m_settings.min, m_depth / 2);
+      } else if (limited) {
+        m_depth = std::min(m_settings.max, m_depth + std::max(1, m_depth / 8));
+      }
+    }
+
+    // exponentially weighted moving average, 1/8 gain
+    static void smooth(duration &avg, duration sample) {
+      avg = avg.count() == 0 ? sample : avg + (sample - avg) / 8;
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_DEPTH_CONTROLLER_H
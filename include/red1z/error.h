@@ -24,13 +24,28 @@ namespace red1z {
     }
   };
 
+  /// a timeout or a deadline expired, the connection is no longer usable
+  struct Timeout : Error {
+    using Error::Error;
+  };
+
   namespace impl {
+    // strerror_r returns an int (XSI) or the message (GNU)
+    inline char const *strerror_text(int r, char const *buf) {
+      return r == 0 ? buf : nullptr;
+    }
+
+    inline char const *strerror_text(char const *msg, char const *) {
+      return msg;
+    }
+
     inline Error make_error(int errnum) {
       char buf[256];
-      if (strerror_r(errnum, buf, 256) != 0) {
+      auto msg = strerror_text(strerror_r(errnum, buf, 256), buf);
+      if (!msg) {
         throw Error("unable to format error ", errnum, " : errno = ", errno);
       }
-        return Error(buf);
+      return Error(msg);
     }
 
     inline void throw_system_error() {
@@ -0,0 +1,147 @@
+// -*- C++ -*-
+#ifndef RED1Z_FIRE_AND_FORGET_H
+#define RED1Z_FIRE_AND_FORGET_H
+
+#include "red1z/command_table.h"
+#include "red1z/context.h"
+#include "red1z/interfaces.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace red1z {
+  /// Commands whose replies are never read: the server is told not to send
+  /// them (CLIENT REPLY, Redis >= 3.2), so nothing is tracked or parsed on
+  /// the client side and throughput is only bounded by the send path.
+  ///
+  /// Commands are buffered and written once `flush_size` bytes are queued,
+  /// a batch is wrapped in CLIENT REPLY OFF / ON, a single command is
+  /// preceded by CLIENT REPLY SKIP. Errors of the commands (e.g. a wrong
+  /// type) are silently ignored by the server. Commands replying data
+  /// (GET, TTL, ...) and the bound form are rejected, see _run().
+  ///
+  /// A FireAndForget borrows the connection of a red1z::Redis (see
+  /// Redis::fire_and_forget()), which must not be used while the
+  /// FireAndForget lives.
+  class FireAndForget : public impl::CommandInterface<FireAndForget> {
+    impl::Socket &m_sock;
+    std::size_t const m_flush_size;
+    std::string m_buffer;
+    std::uint64_t m_buffered = 0;
+    std::uint64_t m_written = 0;
+    int m_unread = 0; // replies of CLIENT REPLY ON not read yet
+
+  public:
+    FireAndForget(impl::Context &ctx, std::size_t flush_size = 1 << 16)
+        : m_sock(ctx.socket()), m_flush_size(flush_size) {
+      if (not ctx.ready()) {
+        throw Error("cannot start fire and forget: requests are pending");
+      }
+      m_buffer.reserve(flush_size);
+      m_buffer = off();
+    }
+
+    FireAndForget(FireAndForget const &) = delete;
+    FireAndForget &operator=(FireAndForget const &) = delete;
+
+    /// flushes, and waits until the server has processed every command
+    ~FireAndForget() {
+      try {
+        finish();
+      } catch (...) {
+      }
+    }
+
+    /// commands replying data are rejected: at compile time for most of
+    /// them, by name for those replying an integer or a string (e.g. TTL,
+    /// EXISTS, TYPE)
+    template <class Cmd> void _run(impl::Command<Cmd> &&cmd) {
+      static_assert(impl::has_report_reply_v<Cmd>,
+                    "the replies of a FireAndForget are not returned, it "
+                    "cannot run commands replying data");
+      auto const name = impl::command_name(cmd.cmd());
+      if (impl::is_read_only(name)) {
+        throw Error("the replies of a FireAndForget are not returned, it "
+                    "cannot run the read-only command ",
+                    name);
+      }
+      queue(std::move(cmd).cmd());
+    }
+
+    template <class Cmd, class Out>
+    void _run_into(impl::Command<Cmd> &&, Out) {
+      static_assert(impl::always_false_v<Out>,
+                    "the replies of a FireAndForget are not returned, it "
+                    "has no bound form");
+    }
+
+    /// write the buffered commands
+    void flush() {
+      if (m_buffered == 0) {
+        return;
+      }
+      // acknowledgements of the previous batches, when already received
+      while (m_unread > 0 and m_sock.wait(0)) {
+        read_ack();
+      }
+      // the buffer always starts with CLIENT REPLY OFF
+      if (m_buffered == 1) {
+        m_buffer.replace(0, off().size(), skip());
+      } else {
+        m_buffer += on();
+        ++m_unread;
+      }
+      m_sock.write(m_buffer.data(), m_buffer.size());
+      m_buffer = off();
+      m_written += std::exchange(m_buffered, 0);
+    }
+
+    /// flush then wait until the server has processed every written batch,
+    /// returns the number of commands written since the last call. Single
+    /// commands written with CLIENT REPLY SKIP are not waited for
+    std::uint64_t finish() {
+      flush();
+      while (m_unread > 0) {
+        read_ack();
+      }
+      return std::exchange(m_written, 0);
+    }
+
+  private:
+    void queue(std::string &&cmd) {
+      m_buffer += cmd;
+      ++m_buffered;
+      if (m_buffer.size() >= m_flush_size) {
+        flush();
+      }
+    }
+
+    void read_ack() {
+      if (auto error = impl::skip_reply(m_sock)) {
+        throw Error(*error);
+      }
+      --m_unread;
+    }
+
+    static std::string const &skip() {
+      static std::string const s =
+          impl::encode_command("CLIENT", "REPLY", "SKIP");
+      return s;
+    }
+
+    static std::string const &off() {
+      static std::string const s =
+          impl::encode_command("CLIENT", "REPLY", "OFF");
+      return s;
+    }
+
+    static std::string const &on() {
+      static std::string const s =
+          impl::encode_command("CLIENT", "REPLY", "ON");
+      return s;
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_FIRE_AND_FORGET_H
@@ -0,0 +1,140 @@
+// -*- C++ -*-
+#ifndef RED1Z_INTERN_H
+#define RED1Z_INTERN_H
+
+#include "red1z/decode.h"
+#include "red1z/io.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace red1z {
+  class Interner;
+
+  /// an interned name: a small id and a view on the name stored in the
+  /// owning Interner, valid as long as the Interner lives.
+  class Name {
+    Interner const *m_owner = nullptr;
+    std::uint32_t m_id = 0;
+    std::string_view m_str;
+
+  public:
+    Name() = default;
+    Name(Interner const *owner, std::uint32_t id, std::string_view str)
+        : m_owner(owner), m_id(id), m_str(str) {}
+
+    std::uint32_t id() const {
+      return m_id;
+    }
+
+    std::string_view str() const {
+      return m_str;
+    }
+
+    operator std::string_view() const {
+      return m_str;
+    }
+
+    /// the Interner which stored the name, null for a default Name
+    Interner const *owner() const {
+      return m_owner;
+    }
+
+    // names are equal iff they come from the same Interner with the same id
+    friend bool operator==(Name const &a, Name const &b) {
+      return a.m_id == b.m_id and a.m_owner == b.m_owner;
+    }
+
+    friend bool operator!=(Name const &a, Name const &b) {
+      return !(a == b);
+    }
+
+    friend bool operator<(Name const &a, Name const &b) {
+      if (a.m_id != b.m_id) {
+        return a.m_id < b.m_id;
+      }
+      return std::less<Interner const *>()(a.m_owner, b.m_owner);
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, Name const &n) {
+      return os << n.m_str;
+    }
+  };
+
+  /// Table of field names seen on a connection: each distinct name is stored
+  /// once and resolves to the same Name afterwards.
+  class Interner {
+    std::deque<std::string> m_names; // references are stable on push_back
+    std::unordered_map<std::string_view, std::uint32_t> m_ids;
+
+  public:
+    Interner() = default;
+    Interner(Interner const &) = delete;
+    Interner &operator=(Interner const &) = delete;
+
+    Name intern(std::string_view str) {
+      if (auto it = m_ids.find(str); it != m_ids.end()) {
+        return {this, it->second, str_of(it->second)};
+      }
+      auto const id = static_cast<std::uint32_t>(m_names.size());
+      std::string_view const stored = m_names.emplace_back(str);
+      m_ids.emplace(stored, id);
+      return {this, id, stored};
+    }
+
+    std::optional<Name> find(std::string_view str) const {
+      if (auto it = m_ids.find(str); it != m_ids.end()) {
+        return Name(this, it->second, str_of(it->second));
+      }
+      return std::nullopt;
+    }
+
+    std::string_view name(std::uint32_t id) const {
+      if (id >= m_names.size()) {
+        throw Error("unknown interned name id: ", id);
+      }
+      return str_of(id);
+    }
+
+    std::size_t size() const {
+      return m_names.size();
+    }
+
+  private:
+    std::string_view str_of(std::uint32_t id) const {
+      return m_names[id];
+    }
+  };
+
+  template <> struct io<Name> {
+    static std::string_view view(Name const &n) {
+      return n.str();
+    }
+
+    static Name read(std::string_view data) {
+      auto names = impl::current_decode_context().names;
+      if (!names) {
+        throw Error("cannot read red1z::Name: name interning is not enabled "
+                    "on this connection");
+      }
+      return names->intern(data);
+    }
+  };
+} // namespace red1z
+
+namespace std {
+  template <> struct hash<red1z::Name> {
+    std::size_t operator()(red1z::Name const &n) const noexcept {
+      // mostly a single Interner: its ids are already distinct
+      return n.id() ^ std::hash<red1z::Interner const *>()(n.owner());
+    }
+  };
+} // namespace std
+
+#endif // RED1Z_INTERN_H
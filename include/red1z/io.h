@@ -9,6 +9,7 @@
 #include <deque>
 #include <forward_list>
 #include <list>
+#include <memory_resource>
 #include <set>
 #include <string>
 #include <unordered_set>
@@ -305,6 +306,22 @@ namespace red1z {
     }
   };
 
+  /// strings allocated from a memory resource, reading moves the reply
+  /// string when it was allocated from a resource
+  template <> struct io<std::pmr::string> {
+    static std::pmr::string read(std::pmr::string &&s) {
+      return std::move(s);
+    }
+
+    static std::pmr::string read(std::string_view v) {
+      return std::pmr::string(v);
+    }
+
+    static std::string_view view(std::pmr::string const &s) {
+      return s;
+    }
+  };
+
   template <class T, std::size_t N>
   struct io<std::array<T, N>>
       : contiguous_container_io<std::array<T, N>, io<std::array<T, N>>>,
@@ -0,0 +1,71 @@
+// -*- C++ -*-
+#ifndef RED1Z_LAZY_H
+#define RED1Z_LAZY_H
+
+#include "red1z/decode.h"
+#include "red1z/io.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace red1z {
+  /// Holds the raw bytes of a value and runs io<T>::read only on first
+  /// access, e.g. mget<Lazy<T>>() only decodes the values actually used.
+  /// The decode context of the connection it was read from (e.g. its name
+  /// interning table, which must outlive it) is used when it is decoded.
+  /// Accessing the value of a const Lazy<T> is not thread-safe.
+  template <class T> class Lazy {
+    std::string m_data;
+    impl::DecodeContext m_ctx;
+    mutable std::optional<T> m_value;
+
+  public:
+    Lazy() = default;
+    explicit Lazy(std::string data,
+                  impl::DecodeContext const &ctx = impl::current_decode_context())
+        : m_data(std::move(data)), m_ctx(ctx) {}
+
+    /// the raw serialized bytes
+    std::string_view data() const {
+      return m_data;
+    }
+
+    bool decoded() const {
+      return m_value.has_value();
+    }
+
+    T const &get() const {
+      if (!m_value) {
+        impl::DecodeScope scope(m_ctx);
+        m_value.emplace(io<T>::read(m_data));
+      }
+      return *m_value;
+    }
+
+    T const &operator*() const {
+      return get();
+    }
+
+    T const *operator->() const {
+      return &get();
+    }
+  };
+
+  template <class T> struct io<Lazy<T>> {
+    // writing a Lazy<T> back sends its raw bytes unchanged
+    static std::string_view view(Lazy<T> const &v) {
+      return v.data();
+    }
+
+    static Lazy<T> read(std::string &&data) {
+      return Lazy<T>(std::move(data));
+    }
+
+    static Lazy<T> read(std::string_view data) {
+      return Lazy<T>(std::string(data));
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_LAZY_H
@@ -0,0 +1,74 @@
+// -*- C++ -*-
+#ifndef RED1Z_OPTIONS_H
+#define RED1Z_OPTIONS_H
+
+#include "red1z/command_table.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace red1z {
+  /// automatic reconnection once the connection to the server is lost
+  struct Reconnect {
+    /// connection attempts before giving up, 0 disables reconnection
+    int max_attempts = 0;
+    /// attempt n waits a random delay up to
+    /// min(max_backoff, initial_backoff * 2^n)
+    std::chrono::milliseconds initial_backoff{10};
+    std::chrono::milliseconds max_backoff{1000};
+    /// whether a command (encoded, see impl::command_part()) whose reply
+    /// was not received may be sent again; once one may not, the following
+    /// ones fail as well. Empty replays nothing
+    std::function<bool(std::string_view)> replayable = impl::is_replayable;
+  };
+
+  /// settings of a connection, given to the Redis constructors or
+  /// from_url(). A zero timeout means no timeout.
+  struct Options {
+    /// bound on establishing the TCP connection
+    std::chrono::milliseconds connect_timeout{0};
+    /// bound on each wait for data from the server, including the wait for
+    /// pub/sub messages: leave it unset on subscriber connections
+    std::chrono::milliseconds read_timeout{0};
+    /// bound on each wait for room in the send buffer
+    std::chrono::milliseconds write_timeout{0};
+    Reconnect reconnect;
+    /// name set with CLIENT SETNAME, part of the handshake, when not empty
+    std::string client_name;
+    /// send the handshake along with the SYN (TCP_FASTOPEN_CONNECT, Linux)
+    /// once the server granted a cookie, saving a round trip. The server
+    /// needs net.ipv4.tcp_fastopen & 2. The connection errors are then
+    /// only reported by the first write or read, so it is not used for
+    /// hosts with several addresses, which connect() must check in turn
+    bool fast_open = false;
+    /// how long the addresses of a host are reused by new connections, 0
+    /// resolves the host for each of them
+    std::chrono::seconds resolve_cache_ttl{30};
+
+    /// TCP_NODELAY: commands are sent right away rather than coalesced by
+    /// Nagle's algorithm
+    bool tcp_nodelay = true;
+    /// SO_SNDBUF and SO_RCVBUF in bytes, 0 keeps the system defaults
+    int send_buffer = 0;
+    int receive_buffer = 0;
+    /// TCP_QUICKACK, re-armed after each read since the kernel may leave
+    /// quick ack mode (Linux)
+    bool quickack = false;
+    /// SO_KEEPALIVE probes once the connection is idle for keepalive_idle
+    /// (0 disables), every keepalive_interval, keepalive_count times
+    std::chrono::seconds keepalive_idle{0};
+    std::chrono::seconds keepalive_interval{0};
+    int keepalive_count = 0;
+    /// SO_BUSY_POLL: microseconds to busy poll the device queue on blocking
+    /// reads, 0 disables (Linux, may need CAP_NET_ADMIN)
+    int busy_poll = 0;
+    /// SO_INCOMING_CPU: CPU on which the packets of the connection should be
+    /// processed, e.g. the one the reading thread is pinned to; -1 for
+    /// none (Linux)
+    int incoming_cpu = -1;
+  };
+} // namespace red1z
+
+#endif // RED1Z_OPTIONS_H
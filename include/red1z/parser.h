@@ -0,0 +1,330 @@
+// -*- C++ -*-
+#ifndef RED1Z_PARSER_H
+#define RED1Z_PARSER_H
+
+#include "red1z/reply.h"
+
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace red1z {
+  /// Incremental RESP parser: feed() accepts the bytes of any number of
+  /// replies split in arbitrary chunks, and calls the visitor as soon as
+  /// each value is complete:
+  ///
+  ///   v.null();                    // nil bulk string or array
+  ///   v.integer(std::int64_t);
+  ///   v.simple_string(string_view);
+  ///   v.error(string_view);
+  ///   v.bulk_string(string_view);
+  ///   v.begin_array(std::int64_t); // followed by its elements
+  ///   v.end_array();
+  ///   v.end_reply();               // after each top level reply
+  ///
+  /// views are only valid during the call. Values read in one chunk are
+  /// passed without any copy, values split across chunks are assembled in
+  /// an internal buffer whose capacity is reused.
+  class RespParser {
+    enum class State { type, line, bulk };
+
+    State m_state = State::type;
+    char m_type = 0;
+    std::int64_t m_need = 0; // remaining bulk bytes, with the final CRLF
+    std::int64_t m_size = 0; // size of the bulk string being read
+    std::string m_partial;
+    std::vector<std::int64_t> m_remaining; // elements left per open array
+
+  public:
+    RespParser() {
+      m_remaining.reserve(4);
+    }
+
+    /// true when no reply is partially parsed
+    bool idle() const {
+      return m_state == State::type and m_remaining.empty();
+    }
+
+    template <class Visitor>
+    void feed(std::string_view data, Visitor &v) {
+      while (!data.empty()) {
+        switch (m_state) {
+        case State::type:
+          m_type = data.front();
+          data.remove_prefix(1);
+          check_type();
+          m_partial.clear();
+          m_state = State::line;
+          break;
+        case State::line:
+          if (auto line = read_line(data)) {
+            on_line(*line, v);
+          }
+          break;
+        case State::bulk:
+          read_bulk(data, v);
+          break;
+        }
+      }
+    }
+
+  private:
+    void check_type() const {
+      switch (m_type) {
+      case '+': case '-': case ':': case '$': case '*':
+        return;
+      default:
+        throw Error("unexpected response type: ", m_type);
+      }
+    }
+
+    /// the current line once complete, consuming it from `data`
+    std::optional<std::string_view> read_line(std::string_view &data) {
+      auto const eol = data.find('\n');
+      if (eol == std::string_view::npos) {
+        m_partial.append(data);
+        data = {};
+        return std::nullopt;
+      }
+      std::string_view line;
+      if (m_partial.empty()) {
+        line = data.substr(0, eol);
+      } else {
+        m_partial.append(data.substr(0, eol));
+        line = m_partial;
+      }
+      data.remove_prefix(eol + 1);
+      if (line.empty() or line.back() != '\r') {
+        throw Error("bad delimiter");
+      }
+      line.remove_suffix(1);
+      return line;
+    }
+
+    static std::int64_t to_integer(std::string_view s) {
+      std::int64_t i = 0;
+      auto r = std::from_chars(s.data(), s.data() + s.size(), i);
+      if (r.ec != std::errc() or r.ptr != s.data() + s.size()) {
+        throw Error("unable to parse ", s, " as an integer");
+      }
+      return i;
+    }
+
+    template <class Visitor> void on_line(std::string_view line, Visitor &v) {
+      m_state = State::type;
+      switch (m_type) {
+      case '+':
+        v.simple_string(line);
+        break;
+      case '-':
+        v.error(line);
+        break;
+      case ':':
+        v.integer(to_integer(line));
+        break;
+      case '$':
+        m_size = to_integer(line);
+        if (m_size == -1) {
+          v.null();
+          break;
+        }
+        if (m_size < -1) {
+          throw Error("negative bulk string size: ", m_size);
+        }
+        m_need = m_size + 2;
+        m_partial.clear();
+        m_state = State::bulk;
+        return; // the value is not complete yet
+      case '*': {
+        auto const n = to_integer(line);
+        if (n == -1) {
+          v.null();
+          break;
+        }
+        if (n < -1) {
+          throw Error("negative array size: ", n);
+        }
+        v.begin_array(n);
+        if (n > 0) {
+          m_remaining.push_back(n);
+          return;
+        }
+        v.end_array();
+        break;
+      }
+      }
+      value_done(v);
+    }
+
+    template <class Visitor>
+    void read_bulk(std::string_view &data, Visitor &v) {
+      std::string_view value;
+      if (m_partial.empty() and
+          data.size() >= static_cast<std::size_t>(m_need)) {
+        // the whole string is in this chunk
+        value = data.substr(0, m_need);
+        data.remove_prefix(m_need);
+      } else {
+        auto const n = std::min<std::size_t>(m_need - m_partial.size(),
+                                             data.size());
+        if (m_partial.capacity() < static_cast<std::size_t>(m_need)) {
+          m_partial.reserve(m_need);
+        }
+        m_partial.append(data.substr(0, n));
+        data.remove_prefix(n);
+        if (m_partial.size() < static_cast<std::size_t>(m_need)) {
+          return;
+        }
+        value = m_partial;
+      }
+      if (value.substr(m_size) != "\r\n") {
+        throw Error("bad delimiter");
+      }
+      m_state = State::type;
+      v.bulk_string(value.substr(0, m_size));
+      value_done(v);
+    }
+
+    /// close the arrays completed by the last value
+    template <class Visitor> void value_done(Visitor &v) {
+      while (!m_remaining.empty()) {
+        if (--m_remaining.back() > 0) {
+          return;
+        }
+        m_remaining.pop_back();
+        v.end_array();
+      }
+      v.end_reply();
+    }
+  };
+
+  /// Builds complete replies out of the chunks passed to feed(), which are
+  /// then popped with next(). Strings are allocated from `mr` when not null.
+  class ReplyParser {
+  public:
+    /// a parsed reply, or the message of an error reply. Errors nested in an
+    /// array (e.g. in EXEC results) are kept as elements of the reply, as
+    /// by the blocking reader
+    struct Result {
+      std::optional<Reply> reply;
+      std::string error;
+
+      /// the reply, throws red1z::Error for an error reply
+      Reply get() && {
+        if (!reply) {
+          throw Error(error);
+        }
+        return std::move(*reply);
+      }
+    };
+
+    explicit ReplyParser(std::pmr::memory_resource *mr = nullptr)
+        : m_builder(mr) {}
+
+    void feed(std::string_view data) {
+      m_parser.feed(data, m_builder);
+    }
+
+    /// true when a complete reply is available
+    bool ready() const {
+      return !m_builder.m_done.empty();
+    }
+
+    std::optional<Result> next() {
+      if (m_builder.m_done.empty()) {
+        return std::nullopt;
+      }
+      auto r = std::move(m_builder.m_done.front());
+      m_builder.m_done.pop_front();
+      return r;
+    }
+
+    bool idle() const {
+      return m_parser.idle();
+    }
+
+  private:
+    struct Builder {
+      std::pmr::memory_resource *m_resource;
+      std::vector<impl::Array> m_stack;
+      std::optional<std::string> m_error;
+      std::deque<Result> m_done;
+
+      explicit Builder(std::pmr::memory_resource *mr) : m_resource(mr) {}
+
+      void null() {
+        add(std::nullopt);
+      }
+
+      void integer(std::int64_t i) {
+        add(i);
+      }
+
+      void simple_string(std::string_view s) {
+        add(string(s));
+      }
+
+      void bulk_string(std::string_view s) {
+        add(string(s));
+      }
+
+      void error(std::string_view s) {
+        if (m_stack.empty()) {
+          m_error.emplace(s);
+        } else {
+          add(impl::ErrorReply{std::string(s)});
+        }
+      }
+
+      void begin_array(std::int64_t n) {
+        auto &a = m_stack.emplace_back(m_resource ? impl::Array(m_resource)
+                                                  : impl::Array());
+        a.reserve(n);
+      }
+
+      void end_array() {
+        auto a = std::move(m_stack.back());
+        m_stack.pop_back();
+        add(std::move(a));
+      }
+
+      void end_reply() {
+        if (m_error) {
+          m_done.push_back({std::nullopt, std::move(*m_error)});
+          m_error.reset();
+        } else {
+          m_done.push_back({std::move(m_value), {}});
+        }
+        m_value.reset();
+      }
+
+    private:
+      std::optional<Reply> m_value;
+
+      impl::Rep string(std::string_view s) const {
+        if (m_resource) {
+          return std::pmr::string(s, m_resource);
+        }
+        return std::string(s);
+      }
+
+      void add(impl::Rep &&r) {
+        if (m_stack.empty()) {
+          m_value.emplace(std::move(r));
+        } else {
+          m_stack.back().emplace_back(std::move(r));
+        }
+      }
+    };
+
+    RespParser m_parser;
+    Builder m_builder;
+  };
+} // namespace red1z
+
+#endif // RED1Z_PARSER_H
@@ -17,7 +17,7 @@ namespace red1z {
     template <class Resolver>
     void _execute(int n, Resolver& resolve) {
       for (int i = 0; i < n; ++i) {
-        resolve(this->m_queue.get_reply());
+        resolve(this->m_queue.get_reply_or_error());
       }
     }
   };
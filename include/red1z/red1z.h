@@ -3,10 +3,19 @@
 #ifndef RED1Z_RED1Z_H
 #define RED1Z_RED1Z_H
 
+#include "red1z/async.h"
+#include "red1z/auto_pipeline.h"
+#include "red1z/bulk_writer.h"
 #include "red1z/context.h"
+#include "red1z/decode_pool.h"
+#include "red1z/fire_and_forget.h"
 #include "red1z/interfaces.h"
+#include "red1z/lazy.h"
 #include "red1z/transaction.h"
 #include "red1z/pipeline.h"
+#include "red1z/result.h"
+#include "red1z/striped_pipeline.h"
+#include "red1z/typed_pipeline.h"
 
 #include <any>
 
@@ -42,6 +51,144 @@ namespace red1z {
 
   extern impl::Passtrough commands;
 
+  namespace impl {
+    /// run commands on Executor with their replies allocated from a
+    /// specific memory resource
+    template <class Executor>
+    class WithResource : public CommandInterface<WithResource<Executor>> {
+      Executor &m_exec;
+      std::pmr::memory_resource *m_resource;
+
+      class Swap {
+        Context &m_ctx;
+        std::pmr::memory_resource *m_saved;
+
+      public:
+        Swap(Context &ctx, std::pmr::memory_resource *mr)
+            : m_ctx(ctx), m_saved(ctx.memory_resource()) {
+          m_ctx.set_memory_resource(mr);
+        }
+
+        ~Swap() {
+          m_ctx.set_memory_resource(m_saved);
+        }
+      };
+
+    public:
+      WithResource(Executor &ex, std::pmr::memory_resource *mr)
+          : m_exec(ex), m_resource(mr) {}
+
+      template <class Cmd> decltype(auto) _run(Command<Cmd> &&cmd) {
+        Swap s(m_exec.m_ctx, m_resource);
+        return m_exec._run(std::move(cmd));
+      }
+
+      template <class Cmd, class Out>
+      decltype(auto) _run_into(Command<Cmd> &&cmd, Out dst) {
+        Swap s(m_exec.m_ctx, m_resource);
+        return m_exec._run_into(std::move(cmd), dst);
+      }
+
+      template <class T = std::any> Pipeline<T> pipeline() {
+        return {m_exec.m_ctx, m_resource};
+      }
+
+      template <class T = std::any> Transaction<T> transaction() {
+        return {m_exec.m_ctx, m_resource};
+      }
+    };
+  } // namespace impl
+
+  namespace impl {
+    /// run commands on Executor with a deadline: the socket operations
+    /// after it throw red1z::Timeout, and poison the connection
+    template <class Executor>
+    class WithDeadline : public CommandInterface<WithDeadline<Executor>> {
+      Executor &m_exec;
+      Socket::clock::time_point m_deadline;
+
+      class Swap {
+        Context &m_ctx;
+        Socket::clock::time_point m_saved;
+
+      public:
+        Swap(Context &ctx, Socket::clock::time_point deadline)
+            : m_ctx(ctx), m_saved(ctx.deadline()) {
+          m_ctx.set_deadline(std::min(deadline, m_saved));
+        }
+
+        ~Swap() {
+          m_ctx.set_deadline(m_saved);
+        }
+      };
+
+    public:
+      WithDeadline(Executor &ex, Socket::clock::time_point deadline)
+          : m_exec(ex), m_deadline(deadline) {}
+
+      template <class Cmd> decltype(auto) _run(Command<Cmd> &&cmd) {
+        Swap s(m_exec.m_ctx, m_deadline);
+        return m_exec._run(std::move(cmd));
+      }
+
+      template <class Cmd, class Out>
+      decltype(auto) _run_into(Command<Cmd> &&cmd, Out dst) {
+        Swap s(m_exec.m_ctx, m_deadline);
+        return m_exec._run_into(std::move(cmd), dst);
+      }
+    };
+  } // namespace impl
+
+  namespace impl {
+    /// run commands on Executor returning a Result<T> instead of throwing
+    /// for their error replies and decoding errors
+    template <class Executor>
+    class NoThrow : public CommandInterface<NoThrow<Executor>> {
+      Executor &m_exec;
+
+    public:
+      explicit NoThrow(Executor &ex) : m_exec(ex) {}
+
+      template <class Cmd>
+      auto _run(Command<Cmd> &&cmd) {
+        using R = decltype(cmd.process(std::declval<Reply>()));
+        auto reply = m_exec.m_ctx.execute_or_error(std::move(cmd).cmd());
+        if (reply.is_error()) {
+          return Result<R>::failure(reply.error());
+        }
+        return decode<R>([&] { return cmd.process(std::move(reply)); });
+      }
+
+      template <class Cmd, class Out>
+      auto _run_into(Command<Cmd> &&cmd, Out dst) {
+        using R = decltype(cmd.process_into(std::declval<Reply>(), dst));
+        auto reply = m_exec.m_ctx.execute_or_error(std::move(cmd).cmd());
+        if (reply.is_error()) {
+          return Result<R>::failure(reply.error());
+        }
+        return decode<R>(
+            [&] { return cmd.process_into(std::move(reply), dst); });
+      }
+
+    private:
+      /// the value returned by `process`, or the message of the error it
+      /// raised, as by Pipeline::try_execute()
+      template <class R, class F> Result<R> decode(F const &process) {
+        DecodeScope scope(m_exec.m_ctx.decode_context());
+        try {
+          if constexpr (std::is_void_v<R>) {
+            process();
+            return Result<R>();
+          } else {
+            return Result<R>(process());
+          }
+        } catch (std::exception const &e) {
+          return Result<R>::failure(e.what());
+        }
+      }
+    };
+  } // namespace impl
+
   template <class T=std::string>
   class Message {
     std::string m_channel;
@@ -72,36 +219,132 @@ namespace red1z {
 
   //  std::variant<std::nullopt_t, Message, PMessage, InfoMessage>;
 
+  /// where and how to connect, e.g. parsed from a URL
+  struct Endpoint {
+    std::string host;
+    int port = 6379;
+    int db = 0;
+    std::optional<std::string> password;
+    std::optional<std::string> username;
+    Options options;
+
+    /// redis://[[username]:password@]host[:port][/db][?name=value&...], the
+    /// parameters override `options`
+    static Endpoint parse(std::string_view url,
+                          Options const& options = Options());
+  };
+
+  class ReplicatedRedis;
+  class SentinelRedis;
+
   class Redis :
     public impl::CommandInterface<Redis>
   {
     impl::Context m_ctx;
+    friend class ReplicatedRedis;
+    friend class SentinelRedis;
+    template <class> friend class impl::WithResource;
+    template <class> friend class impl::NoThrow;
+    template <class> friend class impl::WithDeadline;
   public:
+    using clock = impl::Socket::clock;
+
     Redis(std::string const& hostname, int port = 6379, int db = 0,
           std::optional<std::string> pass = std::nullopt,
-          std::optional<std::string> user = std::nullopt);
+          std::optional<std::string> user = std::nullopt,
+          Options const& options = Options());
 
     Redis(std::string const& hostname, std::string const& password, int db = 0) :
       Redis(hostname, 6379, db, password)
     {}
 
-    static Redis from_url(std::string_view url);
-    static Redis from_url(char const* url) {
-      return from_url(std::string_view(url));
+    explicit Redis(Endpoint const& e) :
+      Redis(e.host, e.port, e.db, e.password, e.username, e.options)
+    {}
+
+    static Redis from_url(std::string_view url,
+                          Options const& options = Options());
+    static Redis from_url(char const* url, Options const& options = Options()) {
+      return from_url(std::string_view(url), options);
+    }
+
+    static Redis from_url(std::string const& url,
+                          Options const& options = Options()) {
+      return from_url(std::string_view(url), options);
+    }
+
+    /// enable field-name interning on this connection: names read as
+    /// red1z::Name (e.g. with streams::interned_entry) resolve through the
+    /// returned table.
+    Interner& intern_names() {
+      return m_ctx.names();
+    }
+
+    /// allocate the replies of this connection from `mr` (which must outlive
+    /// them), nullptr restores the global allocator
+    void set_memory_resource(std::pmr::memory_resource* mr) {
+      m_ctx.set_memory_resource(mr);
+    }
+
+    std::pmr::memory_resource* memory_resource() const {
+      return m_ctx.memory_resource();
+    }
+
+    /// decode the elements of large array replies read into a std::vector
+    /// on the workers of `pool` (which must outlive its use), nullptr
+    /// restores sequential decoding. Not used while names are interned.
+    void set_decode_pool(DecodePool* pool) {
+      m_ctx.set_decode_pool(pool);
+    }
+
+    /// run commands, pipelines or transactions with their replies allocated
+    /// from `mr`: r.with_resource(&mr).get(k)
+    impl::WithResource<Redis> with_resource(std::pmr::memory_resource* mr) {
+      return {*this, mr};
+    }
+
+    /// run commands within `timeout` from now, e.g.
+    /// r.with_deadline(5ms).get(k): once it expires the command throws
+    /// red1z::Timeout and the connection is unusable
+    impl::WithDeadline<Redis> with_deadline(clock::duration timeout) {
+      return {*this, clock::now() + timeout};
+    }
+
+    impl::WithDeadline<Redis> with_deadline(clock::time_point deadline) {
+      return {*this, deadline};
+    }
+
+    /// bound every socket operation of this connection (pipelines,
+    /// transactions...) until reset with set_deadline(std::nullopt)
+    void set_deadline(std::optional<clock::time_point> deadline) {
+      m_ctx.set_deadline(deadline.value_or(clock::time_point::max()));
     }
 
-    static Redis from_url(std::string const& url) {
-      return from_url(std::string_view(url));
+    /// abort the command in progress from another thread, it throws and
+    /// the connection is unusable afterwards
+    void cancel() {
+      m_ctx.cancel();
+    }
+
+    /// run commands returning a red1z::Result<T> holding either their
+    /// result or their error reply, which then costs no exception:
+    /// if (auto n = r.nothrow().incr(k)) { use(*n); }
+    impl::NoThrow<Redis> nothrow() {
+      return impl::NoThrow<Redis>(*this);
     }
 
     template <class Cmd>
     auto _run(impl::Command<Cmd>&& cmd) {
-      return process(cmd.derived(), m_ctx.execute(std::move(cmd).cmd()));
+      auto reply = m_ctx.execute(std::move(cmd).cmd());
+      impl::DecodeScope scope(m_ctx.decode_context());
+      return process(cmd.derived(), std::move(reply));
     }
 
     template <class Cmd, class Out>
     auto _run_into(impl::Command<Cmd>&& cmd, Out dst) {
-      return cmd.process_into(m_ctx.execute(std::move(cmd).cmd()), dst);
+      auto reply = m_ctx.execute(std::move(cmd).cmd());
+      impl::DecodeScope scope(m_ctx.decode_context());
+      return cmd.process_into(std::move(reply), dst);
     }
 
     template <class... Commands>
@@ -112,6 +355,7 @@ namespace red1z {
       (void)_;
       p.append("*1\r\n$4\r\nEXEC\r\n");
       p.discard(1 + sizeof...(Commands));
+      impl::DecodeScope scope(m_ctx.decode_context());
       return process_transaction_reply
         (p.get_reply(), impl::args_indices_v<Commands...>, commands...);
     }
@@ -128,7 +372,11 @@ namespace red1z {
       (void)_;
       //Too good to be true, argument evaluation order messes things up...
       // return std::make_tuple(Commands::process(p.get_reply())...);
-      Reply replies[] = {((void)commands, p.get_reply())...}; //this order is defined ;)
+      Reply replies[] = {((void)commands, p.get_reply_or_error())...}; //this order is defined ;)
+      for (auto const& r : replies) {
+        r.check(); //every reply is read before reporting the first error
+      }
+      impl::DecodeScope scope(m_ctx.decode_context());
       return process_pipeline_replies(replies, impl::args_indices_v<Commands...>, commands...);
     }
 
@@ -137,6 +385,55 @@ namespace red1z {
       return {m_ctx};
     }
 
+    /// one pipeline spread over `connections` (a range of Redis, or of
+    /// pointers to Redis), executed concurrently, see StripedPipeline
+    template <class T = std::any, class Connections>
+    static StripedPipeline<T> striped_pipeline(Connections& connections) {
+      std::vector<impl::Context*> contexts;
+      for (auto& c : connections) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(c)>, Redis>) {
+          contexts.push_back(&c.m_ctx);
+        } else {
+          contexts.push_back(&(*c).m_ctx);
+        }
+      }
+      return StripedPipeline<T>(contexts);
+    }
+
+    /// fluent pipeline typed after its commands, see TypedPipeline
+    TypedPipeline<> typed_pipeline() {
+      return TypedPipeline<>(m_ctx);
+    }
+
+    /// share this connection between threads, batching the commands issued
+    /// concurrently, see AutoPipeline
+    AutoPipeline auto_pipeline(int max_batch = 1024) {
+      return AutoPipeline(m_ctx, max_batch);
+    }
+
+    /// auto pipelining with a batch size adapted to the measured latency
+    AutoPipeline auto_pipeline(AdaptiveDepth const& depth) {
+      return AutoPipeline(m_ctx, depth);
+    }
+
+    /// write commands while their replies are checked by another thread,
+    /// see BulkWriter
+    BulkWriter bulk_writer(std::uint64_t window = 1 << 16,
+                           std::size_t flush_size = 1 << 16) {
+      return BulkWriter(m_ctx, window, flush_size);
+    }
+
+    /// bulk writer with a window adapted to the measured latency
+    BulkWriter bulk_writer(AdaptiveDepth const& window,
+                           std::size_t flush_size = 1 << 16) {
+      return BulkWriter(m_ctx, window, flush_size);
+    }
+
+    /// write commands without their replies, see FireAndForget
+    FireAndForget fire_and_forget(std::size_t flush_size = 1 << 16) {
+      return FireAndForget(m_ctx, flush_size);
+    }
+
     template <class... Cs>
     void subscribe(Cs const&... channels) {
       m_ctx.pubsub_run("SUBSCRIBE", channels...);
@@ -164,16 +461,16 @@ namespace red1z {
 
     template <class T=std::string, class Visitor>
     bool get_message(Visitor&& v, int timeout=-1) {
-      std::vector<Reply> r;
+      impl::Array r;
       if (timeout >= 0) {
         auto msg = m_ctx.get_message(timeout);
         if (!msg) {
           return false;
         }
-        r = std::move(*msg).array();
+        r = std::move(*msg).elements();
       }
       else {
-        r = m_ctx.get_message().array();
+        r = m_ctx.get_message().elements();
       }
 
       auto type = std::move(r[0]).string();
@@ -210,7 +507,7 @@ namespace red1z {
         if (auto m = process_message<T>(std::move(*msg))) {
           return m;
         }
-        elapsed = duration_cast<milliseconds>(start - steady_clock::now()).count();
+        elapsed = duration_cast<milliseconds>(steady_clock::now() - start).count();
       }
       return std::nullopt;
     }
@@ -228,7 +525,7 @@ namespace red1z {
       if (r.array_size() != sizeof...(Commands)) {
         throw Error("unexpected reply size for EXEC");
       }
-      auto elements = std::move(r).array();
+      auto elements = std::move(r).elements();
       return std::make_tuple(process(cmds, std::move(elements[I]))...);
     }
 
@@ -239,7 +536,7 @@ namespace red1z {
 
     template <class T>
     static std::optional<Message<T>> process_message(Reply&& r) {
-      auto reply = std::move(r).array();
+      auto reply = std::move(r).elements();
       auto type = std::move(reply[0]).string();
       if (type == "message") {
         return Message<T>{std::move(reply[1]).string(), std::move(reply[2]).get<T>()};
@@ -247,12 +544,9 @@ namespace red1z {
       if (type == "pmessage") {
         return Message<T>(std::move(reply[2]).string(),
                           std::move(reply[3]).get<T>(),
-                          std::move(reply[2]).string());
-      }
-      else {
-        auto ch = std::move(reply[1]).string();
-        auto n = reply[2].integer();
+                          std::move(reply[1]).string());
       }
+      // (un)subscribe confirmations carry no message
       return std::nullopt;
     }
   };
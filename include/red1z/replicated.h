@@ -0,0 +1,374 @@
+// -*- C++ -*-
+#ifndef RED1Z_REPLICATED_H
+#define RED1Z_REPLICATED_H
+
+#include "red1z/red1z.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+namespace red1z {
+  /// hedged reads of ReplicatedRedis: a read not answered within the
+  /// `quantile` of the recent read latencies (and at least `min_delay`) is
+  /// sent to a second replica as well, the first reply wins
+  struct Hedging {
+    bool enabled = false;
+    double quantile = 0.95;
+    std::chrono::milliseconds min_delay{1};
+  };
+
+  namespace impl {
+    /// quantile of the latest latencies, recomputed every few samples
+    class LatencyQuantile {
+    public:
+      using duration = std::chrono::nanoseconds;
+
+    private:
+      static constexpr std::size_t N = 256;
+      double const m_quantile;
+      std::mutex m_mutex;
+      std::array<duration::rep, N> m_samples{};
+      std::size_t m_count = 0;
+      std::atomic<duration::rep> m_value{-1};
+
+    public:
+      explicit LatencyQuantile(double quantile) : m_quantile(quantile) {}
+
+      void add(duration d) {
+        std::lock_guard lock(m_mutex);
+        m_samples[m_count++ % N] = d.count();
+        if (m_count >= N / 4 and m_count % 32 == 0) {
+          auto const n = std::min(m_count, N);
+          auto sorted = m_samples;
+          auto const k = sorted.begin() +
+                         std::min<std::size_t>(n - 1, m_quantile * n);
+          std::nth_element(sorted.begin(), k, sorted.begin() + n);
+          m_value.store(*k, std::memory_order_relaxed);
+        }
+      }
+
+      /// empty until enough samples were added
+      std::optional<duration> value() const {
+        auto const v = m_value.load(std::memory_order_relaxed);
+        if (v < 0) {
+          return std::nullopt;
+        }
+        return duration(v);
+      }
+    };
+  } // namespace impl
+
+  /// A primary and its replicas, shared between threads: read-only commands
+  /// (see impl::is_read_only()) go to the replica with the fewest requests
+  /// outstanding, the others to the primary. Each connection serves one
+  /// request at a time.
+  ///
+  ///   auto r = red1z::ReplicatedRedis::from_urls(
+  ///       "redis://primary", {"redis://replica1", "redis://replica2"});
+  ///   r.set("k", "v");       // primary
+  ///   auto v = r.get("k");   // a replica, possibly not up to date yet
+  ///
+  /// With Hedging enabled, a slow read is sent to a second replica (when one
+  /// is idle) and the first reply is used; the other one is discarded before
+  /// that connection's next request.
+  class ReplicatedRedis : public impl::CommandInterface<ReplicatedRedis> {
+    using clock = std::chrono::steady_clock;
+
+    struct Node {
+      std::unique_ptr<Redis> redis;
+      std::mutex mutex;
+      std::atomic<int> outstanding{0}; // a leftover counts as one
+      std::optional<impl::CommandQueue> leftover; // reply of a lost hedge
+      std::atomic<bool> has_leftover{false};
+
+      explicit Node(std::unique_ptr<Redis> r) : redis(std::move(r)) {}
+
+      impl::Context &ctx() {
+        return redis->m_ctx;
+      }
+
+      bool usable() {
+        auto const &sock = ctx().socket();
+        return not sock.broken() or
+               sock.options().reconnect.max_attempts > 0;
+      }
+
+      /// called with the lock held
+      void keep_leftover(impl::CommandQueue &&q) {
+        leftover.emplace(std::move(q));
+        ++outstanding;
+        has_leftover.store(true, std::memory_order_relaxed);
+      }
+
+      /// discard the reply of a lost hedge, called with the lock held
+      void settle() {
+        if (leftover) {
+          leftover.reset();
+          --outstanding;
+          has_leftover.store(false, std::memory_order_relaxed);
+        }
+      }
+
+      /// settle once the reply arrived, when the node is idle
+      void try_settle() {
+        if (has_leftover.load(std::memory_order_relaxed)) {
+          std::unique_lock lock(mutex, std::try_to_lock);
+          if (lock and leftover and ctx().socket().wait(0)) {
+            settle();
+          }
+        }
+      }
+    };
+
+    /// a node, counted as outstanding while waited for and used
+    class Lease {
+      Node &m_node;
+      std::unique_lock<std::mutex> m_lock;
+
+    public:
+      explicit Lease(Node &n) : m_node(n) {
+        ++m_node.outstanding;
+        m_lock = std::unique_lock(m_node.mutex);
+        m_node.settle();
+      }
+
+      Lease(Node &n, std::try_to_lock_t) : m_node(n) {
+        ++m_node.outstanding;
+        m_lock = std::unique_lock(m_node.mutex, std::try_to_lock);
+        if (m_lock) {
+          m_node.settle();
+        }
+      }
+
+      Lease(Lease const &) = delete;
+      Lease &operator=(Lease const &) = delete;
+
+      ~Lease() {
+        --m_node.outstanding;
+      }
+
+      bool locked() const {
+        return m_lock.owns_lock();
+      }
+
+      Node &node() {
+        return m_node;
+      }
+
+      impl::Context &ctx() {
+        return m_node.ctx();
+      }
+    };
+
+    Node m_primary;
+    std::vector<std::unique_ptr<Node>> m_replicas;
+    Hedging const m_hedging;
+    impl::LatencyQuantile m_latency;
+    std::atomic<unsigned> m_next{0};
+    std::atomic<std::uint64_t> m_hedges{0};
+
+  public:
+    ReplicatedRedis(std::unique_ptr<Redis> primary,
+                    std::vector<std::unique_ptr<Redis>> replicas,
+                    Hedging const &hedging = Hedging())
+        : m_primary(std::move(primary)), m_hedging(hedging),
+          m_latency(hedging.quantile) {
+      for (auto &r : replicas) {
+        m_replicas.push_back(std::make_unique<Node>(std::move(r)));
+      }
+    }
+
+    static ReplicatedRedis from_urls(std::string_view primary,
+                                     std::vector<std::string> const &replicas,
+                                     Options const &options = Options(),
+                                     Hedging const &hedging = Hedging()) {
+      std::vector<std::unique_ptr<Redis>> nodes;
+      for (auto const &url : replicas) {
+        nodes.push_back(
+            std::make_unique<Redis>(Endpoint::parse(url, options)));
+      }
+      return {std::make_unique<Redis>(Endpoint::parse(primary, options)),
+              std::move(nodes), hedging};
+    }
+
+    template <class Cmd> auto _run(impl::Command<Cmd> &&cmd) {
+      return route(std::move(cmd).cmd(), [&cmd](Reply &&r) {
+        return cmd.process(std::move(r));
+      });
+    }
+
+    template <class Cmd, class Out>
+    auto _run_into(impl::Command<Cmd> &&cmd, Out dst) {
+      return route(std::move(cmd).cmd(), [&cmd, dst](Reply &&r) {
+        return cmd.process_into(std::move(r), dst);
+      });
+    }
+
+    /// run `f(Redis&)` on the primary, e.g. for pipelines and transactions
+    template <class F> decltype(auto) on_primary(F &&f) {
+      Lease l(m_primary);
+      return std::forward<F>(f)(*m_primary.redis);
+    }
+
+    /// number of reads sent to a second replica
+    std::uint64_t hedges() const {
+      return m_hedges.load(std::memory_order_relaxed);
+    }
+
+    /// current delay before hedging a read, empty until enough reads were
+    /// measured
+    std::optional<std::chrono::nanoseconds> hedge_delay() const {
+      auto d = m_latency.value();
+      if (d) {
+        d = std::max<std::chrono::nanoseconds>(*d, m_hedging.min_delay);
+      }
+      return d;
+    }
+
+  private:
+    template <class Process>
+    auto route(std::string &&cmd, Process const &process) {
+      if (impl::is_read_only(impl::command_name(cmd))) {
+        if (auto replica = pick(nullptr)) {
+          return read(*replica, std::move(cmd), process);
+        }
+      }
+      Lease l(m_primary);
+      return decode(l.ctx(), l.ctx().execute(std::move(cmd)), process);
+    }
+
+    template <class Process>
+    static auto decode(impl::Context &ctx, Reply &&reply,
+                       Process const &process) {
+      impl::DecodeScope scope(ctx.decode_context());
+      return process(std::move(reply));
+    }
+
+    /// the usable replica with the fewest outstanding requests other than
+    /// `exclude`, ties broken round robin
+    Node *pick(Node const *exclude) {
+      auto const n = m_replicas.size();
+      auto const first = m_next.fetch_add(1, std::memory_order_relaxed);
+      Node *best = nullptr;
+      for (std::size_t i = 0; i < n; ++i) {
+        auto &node = *m_replicas[(first + i) % n];
+        if (&node == exclude or not node.usable()) {
+          continue;
+        }
+        node.try_settle();
+        if (!best or node.outstanding.load(std::memory_order_relaxed) <
+                         best->outstanding.load(std::memory_order_relaxed)) {
+          best = &node;
+        }
+      }
+      return best;
+    }
+
+    template <class Process>
+    auto read(Node &replica, std::string &&cmd, Process const &process) {
+      Lease a(replica);
+      // the wait for the lease is not part of the server latency
+      auto const start = clock::now();
+      auto const delay = hedge_delay();
+      if (not m_hedging.enabled or not delay or m_replicas.size() < 2) {
+        auto reply = a.ctx().execute(std::move(cmd));
+        m_latency.add(clock::now() - start);
+        return decode(a.ctx(), std::move(reply), process);
+      }
+
+      auto qa = a.ctx().start_pipeline();
+      qa.append(std::string(cmd));
+      qa.flush();
+      auto const ms = std::chrono::ceil<std::chrono::milliseconds>(*delay);
+      if (a.ctx().socket().wait(ms.count())) {
+        auto reply = qa.get_reply();
+        m_latency.add(clock::now() - start);
+        return decode(a.ctx(), std::move(reply), process);
+      }
+
+      // hedge on an idle replica, if any
+      std::optional<Lease> b;
+      if (auto other = pick(&replica)) {
+        b.emplace(*other, std::try_to_lock);
+      }
+      if (!b or not b->locked()) {
+        auto reply = qa.get_reply();
+        m_latency.add(clock::now() - start);
+        return decode(a.ctx(), std::move(reply), process);
+      }
+      auto qb = b->ctx().start_pipeline();
+      qb.append(std::move(cmd));
+      qb.flush();
+      m_hedges.fetch_add(1, std::memory_order_relaxed);
+
+      bool const first = first_ready(a.ctx(), b->ctx());
+      auto &winner = first ? a : *b;
+      auto &loser = first ? *b : a;
+      // the reply of the loser is discarded before its next request
+      loser.node().keep_leftover(first ? std::move(qb) : std::move(qa));
+      auto reply = (first ? qa : qb).get_reply();
+      m_latency.add(clock::now() - start);
+      return decode(winner.ctx(), std::move(reply), process);
+    }
+
+    /// wait until `a` or `b` can be read (or failed), true for `a`. The
+    /// wait is bounded by the deadline of the call and the read timeout, on
+    /// expiry both connections are left unusable as by a read timing out
+    static bool first_ready(impl::Context &a, impl::Context &b) {
+      using namespace std::chrono;
+      using impl::Socket;
+      auto end = std::min(a.socket().deadline(), b.socket().deadline());
+      char const *reason = "read deadline expired";
+      auto const timeout = a.socket().options().read_timeout;
+      if (timeout.count() > 0 and Socket::clock::now() + timeout < end) {
+        end = Socket::clock::now() + timeout;
+        reason = "read timed out";
+      }
+      for (;;) {
+        if (a.socket().wait(0)) {
+          return true;
+        }
+        if (b.socket().wait(0)) {
+          return false;
+        }
+        pollfd fds[2];
+        fds[0].fd = a.fd();
+        fds[1].fd = b.fd();
+        for (auto &p : fds) {
+          p.events = POLLIN;
+          p.revents = 0;
+        }
+        int wait = -1;
+        if (end != Socket::clock::time_point::max()) {
+          auto const left = ceil<milliseconds>(end - Socket::clock::now());
+          wait = std::clamp<decltype(left.count())>(left.count(), 0, INT_MAX);
+        }
+        int const r = poll(fds, 2, wait);
+        if (r == -1 and errno != EINTR) {
+          impl::throw_system_error();
+        }
+        if (r == 0) {
+          a.socket().poison(reason);
+          b.socket().poison(reason);
+          throw Timeout(reason);
+        }
+        if (r > 0) {
+          return fds[0].revents != 0 or fds[1].revents == 0;
+        }
+      }
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_REPLICATED_H
@@ -5,9 +5,12 @@
 #include "red1z/io.h"
 
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <iterator>
 #include <variant>
 #include <vector>
 
@@ -16,16 +19,52 @@ namespace red1z {
 
   namespace impl {
     class Socket;
+    using Array = std::pmr::vector<Reply>;
+
+    /// an error reply (-ERR ...), kept as a value so that reading it never
+    /// throws and the following replies stay readable
+    struct ErrorReply {
+      std::string message;
+    };
+
+    // strings are read as std::pmr::string when replies are allocated from
+    // a memory resource, as std::string otherwise
     using Rep = std::variant<std::nullopt_t, std::int64_t, std::string,
-                             std::vector<Reply>>;
-    Rep read_reply(red1z::impl::Socket &sock);
+                             Array, std::pmr::string, ErrorReply>;
+    Rep read_reply(red1z::impl::Socket &sock,
+                   std::pmr::memory_resource *mr = nullptr);
+    /// parse a reply received in memory, `data` must hold a whole reply
+    Rep read_reply(std::string_view data,
+                   std::pmr::memory_resource *mr = nullptr);
+    /// size of the first reply in `data`, 0 when it is not fully received
+    std::size_t reply_size(std::string_view data);
+    /// consume a reply from `sock` without building it: only the framing is
+    /// parsed and bulk payloads are skipped. Returns the message of the
+    /// (first) error reply it is or contains, once it is wholly consumed;
+    /// only I/O and protocol failures throw
+    std::optional<std::string> skip_reply(red1z::impl::Socket &sock);
+
+    template <class T, class Arg, class Enable = void>
+    struct is_readable_from : std::false_type {};
+
+    template <class T, class Arg>
+    struct is_readable_from<
+        T, Arg, std::void_t<decltype(io<T>::read(std::declval<Arg>()))>>
+        : std::true_type {};
+
+    template <class T, class Arg>
+    constexpr bool is_readable_from_v = is_readable_from<T, Arg>::value;
   } // namespace impl
 
   class Reply {
     impl::Rep m_impl;
 
   public:
-    Reply(impl::Socket &sock) : m_impl(read_reply(sock)) {}
+    /// read a reply from `sock`, allocating it from `mr` when not null
+    Reply(impl::Socket &sock, std::pmr::memory_resource *mr = nullptr)
+        : m_impl(read_reply(sock, mr)) {}
+
+    explicit Reply(impl::Rep rep) : m_impl(std::move(rep)) {}
 
     Reply(Reply const &) = delete;
     Reply(Reply &&) = default;
@@ -36,39 +75,95 @@ namespace red1z {
       return m_impl.index() != 0;
     }
 
+    bool is_error() const {
+      return std::holds_alternative<impl::ErrorReply>(m_impl);
+    }
+
+    /// the message of an error reply, empty otherwise
+    std::string_view error() const {
+      if (auto p = std::get_if<impl::ErrorReply>(&m_impl)) {
+        return p->message;
+      }
+      return {};
+    }
+
+    /// throws the error carried by this reply, if any
+    void check() const {
+      if (auto p = std::get_if<impl::ErrorReply>(&m_impl)) {
+        throw Error(p->message);
+      }
+    }
+
     std::vector<Reply> array(std::int64_t expected_size = -1) && {
-      if (auto p = std::get_if<std::vector<Reply>>(&m_impl)) {
+      auto elements = std::move(*this).elements(expected_size);
+      return {std::make_move_iterator(elements.begin()),
+              std::make_move_iterator(elements.end())};
+    }
+
+    /// the elements of an array reply as stored, allocated from the memory
+    /// resource of the reply (if any): unlike array() they are not moved to
+    /// a std::vector
+    impl::Array elements(std::int64_t expected_size = -1) && {
+      if (auto p = std::get_if<impl::Array>(&m_impl)) {
         if (expected_size >= 0 &&
             static_cast<std::int64_t>(p->size()) != expected_size) {
           throw Error("unexpected array size");
         }
         return std::move(*p);
       }
-      throw Error("cannot access array data");
+      fail("cannot access array data");
     }
 
+    /// a copy when the reply was allocated from a memory resource, see
+    /// view() and get<std::pmr::string>() which do not copy
     std::string string() && {
       if (auto p = std::get_if<std::string>(&m_impl)) {
         return std::move(*p);
       }
-      throw Error("cannot access string data");
+      if (auto p = std::get_if<std::pmr::string>(&m_impl)) {
+        return std::string(*p);
+      }
+      fail("cannot access string data");
+    }
+
+    /// view on the string data, valid as long as this reply lives
+    std::string_view view() const {
+      if (auto p = std::get_if<std::string>(&m_impl)) {
+        return *p;
+      }
+      if (auto p = std::get_if<std::pmr::string>(&m_impl)) {
+        return *p;
+      }
+      fail("cannot access string data");
     }
 
     std::int64_t integer() const {
       if (auto p = std::get_if<std::int64_t>(&m_impl)) {
         return *p;
       }
-      throw Error("cannot access integer data");
+      fail("cannot access integer data");
     }
 
     double floating_point() const {
       if (auto p = std::get_if<std::string>(&m_impl)) {
         return atof(p->c_str());
       }
-      throw Error("cannot access floating point data");
+      if (auto p = std::get_if<std::pmr::string>(&m_impl)) {
+        return atof(p->c_str());
+      }
+      fail("cannot access floating point data");
     }
 
     template <class T> T get() && {
+      if (auto p = std::get_if<std::pmr::string>(&m_impl)) {
+        if constexpr (impl::is_readable_from_v<T, std::pmr::string &&>) {
+          return io<T>::read(std::move(*p));
+        } else if constexpr (impl::is_readable_from_v<T, std::string_view>) {
+          return io<T>::read(std::string_view(*p));
+        } else {
+          return io<T>::read(std::string(*p));
+        }
+      }
       return io<T>::read(std::move(*this).string());
     }
 
@@ -76,18 +171,30 @@ namespace red1z {
       if (!*this) {
         return false;
       }
-      if (auto s = std::get_if<std::string>(&m_impl); s and *s == "OK") {
+      if (is_string() and view() == "OK") {
         return true;
       }
-      throw Error("Unexpected reply type");
+      fail("Unexpected reply type");
+    }
+
+    bool is_string() const {
+      return std::holds_alternative<std::string>(m_impl) or
+             std::holds_alternative<std::pmr::string>(m_impl);
     }
 
     std::int64_t array_size() const {
-      if (auto p = std::get_if<std::vector<Reply>>(&m_impl)) {
+      if (auto p = std::get_if<impl::Array>(&m_impl)) {
         return p->size();
       }
       return 0;
     }
+
+  private:
+    /// an error reply reports its own message when accessed
+    [[noreturn]] void fail(char const *what) const {
+      check();
+      throw Error(what);
+    }
   };
 
 } // namespace red1z
@@ -0,0 +1,118 @@
+// -*- C++ -*-
+#ifndef RED1Z_RESULT_H
+#define RED1Z_RESULT_H
+
+#include "red1z/error.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace red1z {
+  /// The outcome of a single command: its decoded value, or the message of
+  /// its error reply (or of the error raised while decoding it). Returned
+  /// by the non-throwing APIs, e.g. Pipeline::try_execute() or
+  /// Redis::nothrow(), for which an error reply never costs an exception.
+  template <class T> class Result {
+    std::optional<T> m_value;
+    std::string m_error;
+
+  public:
+    Result(T value) : m_value(std::move(value)) {}
+
+    static Result failure(std::string_view message) {
+      return Result(std::string(message), 0);
+    }
+
+    bool ok() const {
+      return m_value.has_value();
+    }
+
+    explicit operator bool() const {
+      return ok();
+    }
+
+    /// empty when ok()
+    std::string const &error() const {
+      return m_error;
+    }
+
+    /// the value, throws red1z::Error with the error message otherwise
+    T &value() & {
+      check();
+      return *m_value;
+    }
+
+    T const &value() const & {
+      check();
+      return *m_value;
+    }
+
+    T &&value() && {
+      check();
+      return std::move(*m_value);
+    }
+
+    T &operator*() {
+      return value();
+    }
+
+    T const &operator*() const {
+      return value();
+    }
+
+    T *operator->() {
+      return &value();
+    }
+
+    T const *operator->() const {
+      return &value();
+    }
+
+  private:
+    Result(std::string error, int) : m_error(std::move(error)) {}
+
+    void check() const {
+      if (!m_value) {
+        throw Error(m_error);
+      }
+    }
+  };
+
+  template <> class Result<void> {
+    bool m_ok = true;
+    std::string m_error;
+
+  public:
+    Result() = default;
+
+    static Result failure(std::string_view message) {
+      Result r;
+      r.m_ok = false;
+      r.m_error = message;
+      return r;
+    }
+
+    bool ok() const {
+      return m_ok;
+    }
+
+    explicit operator bool() const {
+      return ok();
+    }
+
+    std::string const &error() const {
+      return m_error;
+    }
+
+    /// throws red1z::Error with the error message when not ok()
+    void value() const {
+      if (!m_ok) {
+        throw Error(m_error);
+      }
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_RESULT_H
@@ -0,0 +1,342 @@
+// -*- C++ -*-
+#ifndef RED1Z_SCHEMA_H
+#define RED1Z_SCHEMA_H
+
+#include "red1z/reply.h"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+
+namespace red1z {
+  /// Describe how a struct maps to a redis hash by specializing
+  /// red1z::schema<T> with a static constexpr `fields` member:
+  ///
+  ///   template <> struct red1z::schema<User> {
+  ///     static constexpr auto fields = red1z::fields(
+  ///         red1z::field("name", &User::name), red1z::field("age", &User::age));
+  ///   };
+  ///
+  /// member values are read/written with io<M>, std::optional<M> members are
+  /// left empty when the field is absent.
+  template <class T> struct schema;
+
+  template <class T, class M> struct Field {
+    using type = M;
+    std::string_view name;
+    M T::*member;
+  };
+
+  template <class T, class M>
+  constexpr Field<T, M> field(std::string_view name, M T::*member) {
+    return {name, member};
+  }
+
+  template <class... Fs> constexpr std::tuple<Fs...> fields(Fs... fs) {
+    return {fs...};
+  }
+
+  template <class T, class Enable = void>
+  struct has_schema : std::false_type {};
+
+  template <class T>
+  struct has_schema<T, std::void_t<decltype(schema<T>::fields)>>
+      : std::true_type {};
+
+  template <class T> constexpr bool has_schema_v = has_schema<T>::value;
+
+  namespace impl {
+    template <class M> struct field_value { using type = M; };
+    template <class M> struct field_value<std::optional<M>> {
+      using type = M;
+    };
+
+    template <class T> class SchemaIndex {
+      using Fields = std::remove_const_t<decltype(schema<T>::fields)>;
+      static constexpr std::size_t N = std::tuple_size_v<Fields>;
+      using Setter = void (*)(T &, Reply &&);
+
+      std::unordered_map<std::string_view, std::size_t> m_index;
+      std::array<Setter, N> m_setters;
+
+    public:
+      static constexpr std::size_t size = N;
+
+      static SchemaIndex const &get() {
+        static SchemaIndex const index;
+        return index;
+      }
+
+      /// index of the field named `name`, or -1 when T has no such field
+      std::int64_t find(std::string_view name) const {
+        if (auto it = m_index.find(name); it != m_index.end()) {
+          return it->second;
+        }
+        return -1;
+      }
+
+      /// read `r` into the member of `obj` matching `name`, unknown fields
+      /// are ignored
+      bool set(T &obj, std::string_view name, Reply &&r) const {
+        if (auto i = find(name); i >= 0) {
+          m_setters[i](obj, std::move(r));
+          return true;
+        }
+        return false;
+      }
+
+      template <std::size_t I> static constexpr auto const &nth() {
+        return std::get<I>(schema<T>::fields);
+      }
+
+      /// index of the field bound to `member`
+      template <class M> static std::size_t index_of(M T::*member) {
+        auto const i = index_of(member, std::make_index_sequence<N>());
+        if (i < 0) {
+          throw Error("member is not described in red1z::schema<T>");
+        }
+        return i;
+      }
+
+      /// number of arguments needed to encode the fields selected by `mask`
+      static int arg_count(T const &obj, std::bitset<N> const &mask) {
+        return arg_count(obj, mask, std::make_index_sequence<N>());
+      }
+
+      /// encode the fields selected by `mask` as field/value pairs, empty
+      /// std::optional members are skipped
+      static void encode(Encoder &e, T const &obj, std::bitset<N> const &mask) {
+        encode(e, obj, mask, std::make_index_sequence<N>());
+      }
+
+      /// the empty std::optional members of `obj`
+      static std::bitset<N> empty_fields(T const &obj) {
+        std::bitset<N> empty;
+        empty_fields(obj, empty, std::make_index_sequence<N>());
+        return empty;
+      }
+
+      static std::string_view name(std::size_t i) {
+        return name(i, std::make_index_sequence<N>());
+      }
+
+    private:
+      SchemaIndex() : SchemaIndex(std::make_index_sequence<N>()) {}
+
+      template <std::size_t... I>
+      SchemaIndex(std::index_sequence<I...>)
+          : m_setters{&SchemaIndex::set_member<I>...} {
+        m_index.reserve(N);
+        (m_index.emplace(nth<I>().name, I), ...);
+      }
+
+      template <class M, std::size_t... I>
+      static std::int64_t index_of(M T::*member, std::index_sequence<I...>) {
+        std::int64_t i = -1;
+        ((i = (i < 0 && is_member<I>(member)) ? I : i), ...);
+        return i;
+      }
+
+      template <std::size_t I, class M> static bool is_member(M T::*member) {
+        using F = typename std::decay_t<decltype(nth<I>())>::type;
+        if constexpr (std::is_same_v<F, M>) {
+          return nth<I>().member == member;
+        } else {
+          return false;
+        }
+      }
+
+      template <std::size_t I> static bool has_value(T const &obj) {
+        auto const &value = obj.*(nth<I>().member);
+        using M = typename std::decay_t<decltype(nth<I>())>::type;
+        if constexpr (std::is_same_v<M, typename field_value<M>::type>) {
+          (void)value;
+          return true;
+        } else {
+          return value.has_value();
+        }
+      }
+
+      template <std::size_t... I>
+      static int arg_count(T const &obj, std::bitset<N> const &mask,
+                           std::index_sequence<I...>) {
+        return (0 + ... + (mask[I] && has_value<I>(obj) ? 2 : 0));
+      }
+
+      template <std::size_t... I>
+      static void empty_fields(T const &obj, std::bitset<N> &empty,
+                               std::index_sequence<I...>) {
+        (empty.set(I, !has_value<I>(obj)), ...);
+      }
+
+      template <std::size_t... I>
+      static std::string_view name(std::size_t i, std::index_sequence<I...>) {
+        std::string_view n;
+        ((n = I == i ? nth<I>().name : n), ...);
+        return n;
+      }
+
+      template <std::size_t... I>
+      static void encode(Encoder &e, T const &obj, std::bitset<N> const &mask,
+                         std::index_sequence<I...>) {
+        (encode_field<I>(e, obj, mask), ...);
+      }
+
+      template <std::size_t I>
+      static void encode_field(Encoder &e, T const &obj,
+                               std::bitset<N> const &mask) {
+        if (!mask[I] || !has_value<I>(obj)) {
+          return;
+        }
+        auto const &f = nth<I>();
+        using M = typename std::decay_t<decltype(f)>::type;
+        e.encode(f.name);
+        if constexpr (std::is_same_v<M, typename field_value<M>::type>) {
+          e.encode(obj.*(f.member));
+        } else {
+          e.encode(*(obj.*(f.member)));
+        }
+      }
+
+      template <std::size_t I> static void set_member(T &obj, Reply &&r) {
+        auto const &f = nth<I>();
+        using M = typename std::decay_t<decltype(f)>::type;
+        using V = typename field_value<M>::type;
+        if (!r) {
+          return;
+        }
+        obj.*(f.member) = std::move(r).template get<V>();
+      }
+    };
+  } // namespace impl
+
+  /// A struct described by red1z::schema<T> that remembers which of its
+  /// members changed, hset(key, tracked) then only writes those fields.
+  template <class T> class Tracked {
+    using Index = impl::SchemaIndex<T>;
+    T m_value;
+    std::bitset<Index::size> m_dirty;
+    // the generation at which each member was last marked dirty
+    std::array<std::uint64_t, Index::size> m_marked{};
+    std::uint64_t m_generation = 0;
+
+  public:
+    Tracked() = default;
+    explicit Tracked(T value) : m_value(std::move(value)) {}
+
+    T const &value() const {
+      return m_value;
+    }
+
+    T const &operator*() const {
+      return m_value;
+    }
+
+    T const *operator->() const {
+      return &m_value;
+    }
+
+    template <class M, class V> Tracked &set(M T::*member, V &&value) {
+      m_value.*member = std::forward<V>(value);
+      mark(member);
+      return *this;
+    }
+
+    /// writable access to a member, which is marked as dirty
+    template <class M> M &modify(M T::*member) {
+      mark(member);
+      return m_value.*member;
+    }
+
+    template <class M> void mark(M T::*member) {
+      auto const i = Index::index_of(member);
+      m_dirty.set(i);
+      m_marked[i] = ++m_generation;
+    }
+
+    template <class M> bool dirty(M T::*member) const {
+      return m_dirty.test(Index::index_of(member));
+    }
+
+    bool dirty() const {
+      return m_dirty.any();
+    }
+
+    void mark_all() {
+      m_dirty.set();
+      m_marked.fill(++m_generation);
+    }
+
+    void mark_clean() {
+      m_dirty.reset();
+    }
+
+    /// increases each time a member is marked dirty
+    std::uint64_t generation() const {
+      return m_generation;
+    }
+
+    /// mark the members selected by `fields` clean once written, except
+    /// those marked dirty again after `generation` (when the write was
+    /// queued), whose new value is still to be written
+    void mark_clean(std::bitset<Index::size> const &fields,
+                    std::uint64_t generation) {
+      for (std::size_t i = 0; i < Index::size; ++i) {
+        if (fields[i] and m_marked[i] <= generation) {
+          m_dirty.reset(i);
+        }
+      }
+    }
+
+    /// replace the tracked value, leaving every member clean
+    void reset(T value) {
+      m_value = std::move(value);
+      m_dirty.reset();
+    }
+
+    std::bitset<Index::size> const &dirty_fields() const {
+      return m_dirty;
+    }
+
+    /// mutable access without tracking, used when loading the value
+    T &untracked() {
+      return m_value;
+    }
+  };
+
+  namespace impl {
+    /// encode `cmd key field value...` with the dirty fields of `obj`,
+    /// which are left dirty: a dirty empty std::optional member is rejected
+    /// since a field cannot be removed by the same command
+    template <class K, class T>
+    std::string encode_dirty(std::string_view cmd, K const &key,
+                             Tracked<T> const &obj) {
+      using Index = SchemaIndex<T>;
+      auto const removed = obj.dirty_fields() & Index::empty_fields(*obj);
+      if (removed.any()) {
+        std::size_t i = 0;
+        while (!removed[i]) {
+          ++i;
+        }
+        throw Error("cannot write the empty member '", Index::name(i),
+                    "': remove its field with hdel()");
+      }
+      auto const n = Index::arg_count(obj.value(), obj.dirty_fields());
+      if (n == 0) {
+        throw Error("no dirty field to write");
+      }
+      Encoder e(2 + n);
+      e.encode(cmd);
+      e.encode(key);
+      Index::encode(e, obj.value(), obj.dirty_fields());
+      return e.value();
+    }
+  } // namespace impl
+} // namespace red1z
+
+#endif // RED1Z_SCHEMA_H
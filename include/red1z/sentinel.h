@@ -0,0 +1,299 @@
+// -*- C++ -*-
+#ifndef RED1Z_SENTINEL_H
+#define RED1Z_SENTINEL_H
+
+#include "red1z/red1z.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace red1z {
+  /// The primary of a Redis Sentinel deployment: its address is asked to
+  /// the sentinels (SENTINEL get-master-addr-by-name) and a watcher thread,
+  /// subscribed to +switch-master (and +promoted-slave) on one of them,
+  /// connects to the new primary on failover. Callers only swap to that
+  /// connection on their next command, so a failover never blocks them on
+  /// a connection.
+  ///
+  ///   red1z::SentinelRedis r(
+  ///       "mymaster",
+  ///       {red1z::Endpoint::parse("redis://sentinel1:26379"),
+  ///        red1z::Endpoint::parse("redis://sentinel2:26379")},
+  ///       red1z::Endpoint::parse("redis://:password@mymaster/0"));
+  ///   r.set("k", "v");
+  ///
+  /// The primary endpoint gives the credentials, db and options, its host
+  /// (any name) and port are replaced by the discovered ones. Like Redis,
+  /// it is used by one thread at a time. A command failing on a lost
+  /// connection or with READONLY throws and makes the watcher query the
+  /// sentinels again, and reconnect to the primary when the connection was
+  /// lost even if its address did not change (e.g. after a restart).
+  class SentinelRedis : public impl::CommandInterface<SentinelRedis> {
+  public:
+    struct Address {
+      std::string host;
+      int port;
+
+      bool operator==(Address const &o) const {
+        return host == o.host and port == o.port;
+      }
+
+      bool operator!=(Address const &o) const {
+        return !(*this == o);
+      }
+    };
+
+  private:
+    std::string const m_name;
+    std::vector<Endpoint> const m_sentinels;
+    Endpoint const m_primary;
+
+    std::unique_ptr<Redis> m_current; // used by the caller only
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::unique_ptr<Redis> m_next; // the new primary, not used yet
+    Address m_address;             // of m_next, or of m_current
+    std::atomic<bool> m_switched{false};
+    std::atomic<bool> m_refresh{false};
+    std::atomic<bool> m_broken{false}; // m_current lost its connection
+    std::atomic<std::uint64_t> m_failovers{0};
+    bool m_stop = false;
+    std::thread m_watcher;
+
+  public:
+    SentinelRedis(std::string name, std::vector<Endpoint> sentinels,
+                  Endpoint primary = Endpoint())
+        : m_name(std::move(name)), m_sentinels(std::move(sentinels)),
+          m_primary(std::move(primary)) {
+      auto address = query();
+      if (!address) {
+        throw Error("no sentinel knows the primary '", m_name, "'");
+      }
+      m_current = connect(*address);
+      m_address = std::move(*address);
+      m_watcher = std::thread([this] { watch(); });
+    }
+
+    SentinelRedis(SentinelRedis const &) = delete;
+    SentinelRedis &operator=(SentinelRedis const &) = delete;
+
+    ~SentinelRedis() {
+      {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      m_watcher.join();
+    }
+
+    template <class Cmd> auto _run(impl::Command<Cmd> &&cmd) {
+      auto &r = current();
+      try {
+        return r._run(std::move(cmd));
+      } catch (Error const &e) {
+        failed(r, e);
+        throw;
+      }
+    }
+
+    template <class Cmd, class Out>
+    auto _run_into(impl::Command<Cmd> &&cmd, Out dst) {
+      auto &r = current();
+      try {
+        return r._run_into(std::move(cmd), dst);
+      } catch (Error const &e) {
+        failed(r, e);
+        throw;
+      }
+    }
+
+    /// run `f(Redis&)` on the current primary, e.g. for pipelines and
+    /// transactions
+    template <class F> decltype(auto) on_primary(F &&f) {
+      auto &r = current();
+      try {
+        return std::forward<F>(f)(r);
+      } catch (Error const &e) {
+        failed(r, e);
+        throw;
+      }
+    }
+
+    /// the address of the primary, possibly not used by the caller yet
+    Address primary_address() {
+      std::lock_guard lock(m_mutex);
+      return m_address;
+    }
+
+    /// number of switches to a new primary
+    std::uint64_t failovers() const {
+      return m_failovers.load(std::memory_order_relaxed);
+    }
+
+    /// make the watcher ask the sentinels for the primary again
+    void refresh() {
+      m_refresh.store(true, std::memory_order_relaxed);
+    }
+
+  private:
+    /// the connection to use, the one of the new primary after a failover
+    Redis &current() {
+      if (m_switched.load(std::memory_order_acquire)) {
+        std::unique_ptr<Redis> old;
+        {
+          std::lock_guard lock(m_mutex);
+          old = std::exchange(m_current, std::move(m_next));
+          m_switched.store(false, std::memory_order_relaxed);
+        }
+      }
+      return *m_current;
+    }
+
+    void failed(Redis &r, Error const &e) {
+      if (r.m_ctx.socket().broken()) {
+        m_broken.store(true, std::memory_order_relaxed);
+        refresh();
+      } else if (std::string_view(e.what()).substr(0, 8) == "READONLY") {
+        refresh();
+      }
+    }
+
+    /// the primary according to the first sentinel which knows it
+    std::optional<Address> query() const {
+      for (auto const &s : m_sentinels) {
+        try {
+          Redis sentinel(s);
+          auto reply = sentinel.m_ctx.run("SENTINEL",
+                                          "get-master-addr-by-name", m_name);
+          if (!reply) {
+            continue;
+          }
+          auto a = std::move(reply).elements(2);
+          auto host = std::move(a[0]).string();
+          return Address{std::move(host), std::stoi(std::move(a[1]).string())};
+        } catch (Error const &) {
+        } catch (std::logic_error const &) { // invalid port
+        }
+      }
+      return std::nullopt;
+    }
+
+    /// a connection to `address`, checked to be a primary (a sentinel may
+    /// not know about a failover yet)
+    std::unique_ptr<Redis> connect(Address const &address) const {
+      auto e = m_primary;
+      e.host = address.host;
+      e.port = address.port;
+      auto r = std::make_unique<Redis>(e);
+      auto role = r->m_ctx.run("ROLE").elements();
+      if (role.empty() or std::move(role[0]).string() != "master") {
+        throw Error(address.host, ':', address.port, " is not a primary");
+      }
+      return r;
+    }
+
+    /// connect to `address` if it is a new primary, or if the connection
+    /// of the caller was lost, outside of the lock
+    void switch_to(Address const &address) {
+      bool moved;
+      {
+        std::lock_guard lock(m_mutex);
+        moved = address != m_address;
+      }
+      if (not moved and not m_broken.load(std::memory_order_relaxed)) {
+        return;
+      }
+      auto r = connect(address);
+      std::lock_guard lock(m_mutex);
+      m_next = std::move(r);
+      m_address = address;
+      m_broken.store(false, std::memory_order_relaxed);
+      m_switched.store(true, std::memory_order_release);
+      if (moved) {
+        m_failovers.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    /// a primary which cannot be connected to yet (e.g. not promoted yet)
+    /// is asked for again after the next wait for messages, keeping the
+    /// subscription
+    void refresh_now() {
+      m_refresh.store(false, std::memory_order_relaxed);
+      if (auto address = query()) {
+        try {
+          switch_to(*address);
+        } catch (Error const &) {
+          refresh();
+        }
+      }
+    }
+
+    /// +switch-master: "<name> <old ip> <old port> <new ip> <new port>",
+    /// +promoted-slave: "slave <ip>:<port> <ip> <port> @ <name> <old ip>
+    /// <old port>", published about a second earlier by the sentinel which
+    /// led the failover
+    void on_event(std::string const &channel, std::string const &payload) {
+      std::istringstream in(payload);
+      std::string name, skip;
+      Address address;
+      bool parsed = false;
+      if (channel == "+switch-master") {
+        parsed = bool(in >> name >> skip >> skip >> address.host >>
+                      address.port);
+      } else if (channel == "+promoted-slave") {
+        parsed = bool(in >> skip >> skip >> address.host >> address.port >>
+                      skip >> name);
+      }
+      if (parsed and name == m_name) {
+        try {
+          switch_to(address);
+        } catch (Error const &) {
+          refresh();
+        }
+      }
+    }
+
+    bool stopping(std::chrono::milliseconds wait) {
+      std::unique_lock lock(m_mutex);
+      return m_cv.wait_for(lock, wait, [this] { return m_stop; });
+    }
+
+    /// follow the failovers announced by the sentinels in turn, each
+    /// subscription is followed by a query since a switch may have been
+    /// missed meanwhile
+    void watch() {
+      using namespace std::chrono_literals;
+      for (std::size_t i = 0; not stopping(0ms); ++i) {
+        try {
+          Redis sentinel(m_sentinels[i % m_sentinels.size()]);
+          sentinel.subscribe("+switch-master", "+promoted-slave");
+          refresh_now();
+          while (not stopping(0ms)) {
+            if (auto msg = sentinel.get_message<std::string>(100)) {
+              on_event(msg->channel(), msg->payload());
+            }
+            if (m_refresh.load(std::memory_order_relaxed)) {
+              refresh_now();
+            }
+          }
+        } catch (Error const &) {
+          if (stopping(100ms)) {
+            return;
+          }
+        }
+      }
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_SENTINEL_H
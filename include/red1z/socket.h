@@ -3,7 +3,10 @@
 #define RED1Z_SOCKET_H
 
 #include "red1z/error.h"
+#include "red1z/options.h"
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <vector>
 
@@ -18,12 +21,29 @@ namespace red1z {
       SocketFd();
       ~SocketFd();
 
+      SocketFd(SocketFd const &) = delete;
+      SocketFd &operator=(SocketFd const &) = delete;
+
+      /// close the socket (if any) and create a new one
+      void reopen(int family);
+
       operator int() const {
         return m_fd;
       }
     };
 
+    /// the receive side (read, peek, discard, wait) and the send side
+    /// (write, write_many) share no state and may each be used by a
+    /// different thread
+    ///
+    /// Once an operation timed out, was cancelled or failed, the stream is
+    /// out of sync with the commands sent: the socket is poisoned and every
+    /// further operation throws.
     class Socket {
+    public:
+      using clock = std::chrono::steady_clock;
+
+    private:
       SocketFd m_fd;
       static constexpr int N = 256;
       char m_buf[N];
@@ -31,9 +51,51 @@ namespace red1z {
       int m_pos = 0;
       msghdr m_msg;
       std::vector<iovec> m_iov_queue;
+      std::string m_host;
+      int m_port;
+      Options m_options;
+      clock::time_point m_deadline = clock::time_point::max();
+      std::atomic<char const *> m_broken{nullptr}; // why it was poisoned
+      // connected with fast open, no data received yet: connect() did not
+      // confirm the address
+      bool m_unconfirmed = false;
 
     public:
-      Socket(std::string const &host, int port);
+      Socket(std::string const &host, int port,
+             Options const &options = Options());
+
+      /// operations after `deadline` throw red1z::Timeout, max() for none
+      void set_deadline(clock::time_point deadline) {
+        m_deadline = deadline;
+      }
+
+      clock::time_point deadline() const {
+        return m_deadline;
+      }
+
+      /// abort the blocking operations of other threads, and poison the
+      /// socket
+      void cancel();
+
+      /// whether the socket was poisoned
+      bool broken() const {
+        return m_broken.load(std::memory_order_acquire) != nullptr;
+      }
+
+      /// whether it was poisoned by the loss of the connection (rather than a
+      /// timeout or a cancellation)
+      bool connection_lost() const;
+
+      /// mark the socket unusable for `reason` (a string literal), returns
+      /// the reason of the first failure
+      char const *poison(char const *reason);
+
+      /// connect again to the same server, discarding buffered data
+      void reconnect();
+
+      Options const &options() const {
+        return m_options;
+      }
 
       bool wait(int timeout = -1);
 
@@ -57,6 +119,15 @@ namespace red1z {
 
     private:
       std::int64_t do_read(char *out, std::int64_t n, int flags = 0);
+      void open();
+      void configure(bool fast_open);
+      void quickack();
+      void connect_to(sockaddr const *addr, socklen_t len,
+                      std::chrono::milliseconds timeout);
+      void await(short events, char const *what);
+      void check() const;
+      [[noreturn]] void fail_io(char const *timeout);
+      void forget_unconfirmed();
     };
   } // namespace impl
 } // namespace red1z
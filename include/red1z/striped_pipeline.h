@@ -0,0 +1,230 @@
+// -*- C++ -*-
+#ifndef RED1Z_STRIPED_PIPELINE_H
+#define RED1Z_STRIPED_PIPELINE_H
+
+#include "red1z/command_table.h"
+#include "red1z/pipeline.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace red1z {
+  namespace impl {
+    /// the part of `key` hashed to pick a stripe: like Redis Cluster hash
+    /// tags, only the content of the first non-empty {...} when present, so
+    /// related keys can be kept on the same connection
+    inline std::string_view hashed_part(std::string_view key) {
+      auto const open = key.find('{');
+      if (open != key.npos) {
+        auto const close = key.find('}', open + 1);
+        if (close != key.npos and close > open + 1) {
+          return key.substr(open + 1, close - open - 1);
+        }
+      }
+      return key;
+    }
+
+    /// threads running the sub-pipelines of the striped pipelines: shared
+    /// by all of them and only added when no thread is idle, so execute()
+    /// starts no thread once the pool has grown to the usual load
+    class StripeWorkers {
+      std::mutex m_mutex;
+      std::condition_variable m_cv;
+      std::deque<std::function<void()>> m_tasks;
+      std::vector<std::thread> m_threads;
+      std::size_t m_idle = 0;
+      bool m_stop = false;
+
+    public:
+      StripeWorkers() = default;
+      StripeWorkers(StripeWorkers const &) = delete;
+      StripeWorkers &operator=(StripeWorkers const &) = delete;
+
+      ~StripeWorkers() {
+        {
+          std::lock_guard lock(m_mutex);
+          m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto &t : m_threads) {
+          t.join();
+        }
+      }
+
+      static StripeWorkers &shared() {
+        static StripeWorkers workers;
+        return workers;
+      }
+
+      /// run `task` on a worker, which must not throw
+      void post(std::function<void()> task) {
+        std::lock_guard lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        if (m_idle < m_tasks.size()) {
+          m_threads.emplace_back([this] { work(); });
+        } else {
+          m_cv.notify_one();
+        }
+      }
+
+    private:
+      void work() {
+        std::unique_lock lock(m_mutex);
+        for (;;) {
+          ++m_idle;
+          m_cv.wait(lock, [this] { return m_stop or !m_tasks.empty(); });
+          --m_idle;
+          if (m_tasks.empty()) {
+            return;
+          }
+          auto task = std::move(m_tasks.front());
+          m_tasks.pop_front();
+          lock.unlock();
+          task();
+          lock.lock();
+        }
+      }
+    };
+  } // namespace impl
+
+  /// A pipeline spread over several connections to the same server: each
+  /// command goes to the connection picked by the hash of its key (see
+  /// impl::command_first_key()), so the commands on a given key run in
+  /// order, and the commands without a key go to the first connection.
+  /// execute() runs the sub-pipelines concurrently, on the calling thread
+  /// and on threads shared by the striped pipelines, and returns the results
+  /// in the order the commands were queued.
+  ///
+  ///   std::vector<std::unique_ptr<red1z::Redis>> conns = ...;
+  ///   auto p = red1z::Redis::striped_pipeline(conns);
+  ///   for (auto& k : keys) p.get(k);
+  ///   auto values = p.execute();
+  ///
+  /// Commands on different keys, and multi-key commands (routed by their
+  /// first key), are not ordered with respect to each other.
+  template <class T>
+  class StripedPipeline : public impl::CommandInterface<StripedPipeline<T>> {
+    struct Route {
+      int stripe;
+      int index;
+    };
+
+    std::vector<std::unique_ptr<Pipeline<T>>> m_stripes;
+    std::vector<int> m_sizes;
+    std::vector<Route> m_routes;
+
+  public:
+    StripedPipeline(std::vector<impl::Context *> const &contexts,
+                    std::pmr::memory_resource *mr = nullptr)
+        : m_sizes(contexts.size()) {
+      if (contexts.empty()) {
+        throw Error("cannot stripe a pipeline over no connection");
+      }
+      m_stripes.reserve(contexts.size());
+      for (auto ctx : contexts) {
+        m_stripes.push_back(std::make_unique<Pipeline<T>>(*ctx, mr));
+      }
+    }
+
+    template <class Cmd> StripedPipeline &_run(impl::Command<Cmd> &&cmd) {
+      stripe(cmd)._run(std::move(cmd));
+      return *this;
+    }
+
+    template <class Cmd, class Out>
+    StripedPipeline &_run_into(impl::Command<Cmd> &&cmd, Out out) {
+      stripe(cmd)._run_into(std::move(cmd), out);
+      return *this;
+    }
+
+    int size() const {
+      return m_routes.size();
+    }
+
+    /// execute the queued commands, returns their results as a
+    /// std::vector<T> (nothing for a StripedPipeline<void>). When some
+    /// sub-pipelines fail, the others are still executed and the first
+    /// error is rethrown
+    auto execute() {
+      if constexpr (std::is_void_v<T>) {
+        run_stripes([](Pipeline<T> &p, int) { p.execute(); });
+      } else {
+        std::vector<std::vector<T>> results(m_stripes.size());
+        run_stripes([&results](Pipeline<T> &p, int i) {
+          results[i] = p.execute();
+        });
+        std::vector<T> out;
+        out.reserve(m_routes.size());
+        for (auto const &r : m_routes) {
+          out.push_back(std::move(results[r.stripe][r.index]));
+        }
+        return out;
+      }
+    }
+
+    void discard() {
+      for (auto &p : m_stripes) {
+        p->discard();
+      }
+    }
+
+  private:
+    template <class Cmd> Pipeline<T> &stripe(impl::Command<Cmd> const &cmd) {
+      auto const key = impl::command_first_key(cmd.cmd());
+      int const s = key.empty() ? 0
+                                : std::hash<std::string_view>()(
+                                      impl::hashed_part(key)) %
+                                      m_stripes.size();
+      m_routes.push_back({s, m_sizes[s]++});
+      return *m_stripes[s];
+    }
+
+    template <class F> void run_stripes(F const &f) {
+      std::vector<std::exception_ptr> errors(m_stripes.size());
+      auto run = [&](int i) {
+        try {
+          f(*m_stripes[i], i);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      };
+      std::mutex mutex;
+      std::condition_variable done;
+      auto left = std::count_if(m_sizes.begin() + 1, m_sizes.end(),
+                                [](int n) { return n > 0; });
+      auto &workers = impl::StripeWorkers::shared();
+      for (std::size_t i = 1; i < m_stripes.size(); ++i) {
+        if (m_sizes[i] > 0) {
+          workers.post([&, i] {
+            run(i);
+            std::lock_guard lock(mutex);
+            if (--left == 0) {
+              done.notify_one();
+            }
+          });
+        } else {
+          run(i);
+        }
+      }
+      run(0);
+      std::unique_lock lock(mutex);
+      done.wait(lock, [&left] { return left == 0; });
+      for (auto &e : errors) {
+        if (e) {
+          std::rethrow_exception(e);
+        }
+      }
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_STRIPED_PIPELINE_H
@@ -11,18 +11,37 @@ namespace red1z {
     friend Base;
 
   public:
-    Transaction(impl::Context &c) : Base(c) {
+    Transaction(impl::Context &c, std::pmr::memory_resource *mr = nullptr)
+        : Base(c, mr) {
       this->m_queue.append("*1\r\n$5\r\nMULTI\r\n");
     }
 
   private:
     template <class Resolver> void _execute(int n, Resolver &resolve) {
       this->m_queue.append("*1\r\n$4\r\nEXEC\r\n");
-      // discard MULTI + all the commands
-      this->m_queue.discard(n + 1);
+      // discard MULTI + all the commands, a command rejected while queued
+      // aborts the whole transaction (EXEC then fails with EXECABORT)
+      std::optional<Error> rejected;
+      try {
+        this->m_queue.discard(n + 1);
+      } catch (Error const &e) {
+        rejected = e;
+      }
 
-      auto elements = this->m_queue.get_reply().array(); // consume EXEC
+      auto exec = this->m_queue.get_reply_or_error(); // consume EXEC
+      if (rejected or exec.is_error() or !exec) {
+        // every command fails with the reason of the abort
+        auto const msg =
+            rejected ? std::string(rejected->what())
+                     : exec ? std::string(exec.error())
+                            : "transaction aborted: a watched key changed"s;
+        for (int i = 0; i < n; ++i) {
+          resolve(Reply(impl::Rep(impl::ErrorReply{msg})));
+        }
+        return;
+      }
 
+      auto elements = std::move(exec).elements();
       if (n != static_cast<int>(elements.size())) {
         throw Error("unexpected replies in transaction");
       }
@@ -0,0 +1,123 @@
+// -*- C++ -*-
+#ifndef RED1Z_TYPED_PIPELINE_H
+#define RED1Z_TYPED_PIPELINE_H
+
+#include "red1z/context.h"
+#include "red1z/interfaces.h"
+
+#include <tuple>
+#include <utility>
+
+namespace red1z {
+  namespace impl {
+    template <class Cmd> struct TypedEntry {
+      using result_type = decltype(Cmd::process(std::declval<Reply>()));
+
+      result_type resolve(Reply &&r) {
+        return Cmd::process(std::move(r));
+      }
+    };
+
+    template <class Cmd, class Out> struct BoundTypedEntry {
+      using result_type = decltype(
+          Cmd::process_into(std::declval<Reply>(), std::declval<Out &>()));
+      Out out;
+
+      result_type resolve(Reply &&r) {
+        return Cmd::process_into(std::move(r), out);
+      }
+    };
+  } // namespace impl
+
+  /// A fluent pipeline whose type accumulates the result type of each queued
+  /// command, execute() returns them as a std::tuple:
+  ///
+  ///   auto [v, n] = r.typed_pipeline().get<int>("k").incr("c").execute();
+  ///
+  /// every command returns a new pipeline and leaves the previous one empty,
+  /// so commands must be chained (or the result reassigned).
+  template <class... Entries>
+  class TypedPipeline
+      : public impl::CommandInterface<TypedPipeline<Entries...>> {
+    template <class...> friend class TypedPipeline;
+
+    impl::CommandQueue m_queue;
+    std::tuple<Entries...> m_entries;
+
+    TypedPipeline(impl::CommandQueue &&queue, std::tuple<Entries...> &&entries)
+        : m_queue(std::move(queue)), m_entries(std::move(entries)) {}
+
+  public:
+    using result_type = std::tuple<typename Entries::result_type...>;
+
+    explicit TypedPipeline(impl::Context &c) : m_queue(c.start_pipeline()) {}
+
+    template <class Cmd> auto _run(impl::Command<Cmd> &&cmd) {
+      return append(std::move(cmd), impl::TypedEntry<Cmd>{});
+    }
+
+    template <class Cmd, class Out>
+    auto _run_into(impl::Command<Cmd> &&cmd, Out out) {
+      return append(std::move(cmd), impl::BoundTypedEntry<Cmd, Out>{out});
+    }
+
+    result_type execute() {
+      check_attached();
+      // move the queue out, the pipeline cannot be executed twice
+      auto queue = std::move(m_queue);
+      impl::DecodeScope scope(queue.decode_context());
+      return resolve(queue, std::index_sequence_for<Entries...>());
+    }
+
+    /// execute the pipeline calling `visitor(result)` with the typed result
+    /// of each command as soon as its reply is read (e.g. with a generic
+    /// lambda or an overload set)
+    template <class Visitor> void execute(Visitor &&visitor) {
+      check_attached();
+      auto queue = std::move(m_queue);
+      impl::DecodeScope scope(queue.decode_context());
+      visit(queue, visitor, std::index_sequence_for<Entries...>());
+    }
+
+    void discard() {
+      check_attached();
+      auto queue = std::move(m_queue);
+      queue.discard();
+    }
+
+  private:
+    void check_attached() const {
+      if (!m_queue.attached()) {
+        throw Error("typed pipeline already executed or extended");
+      }
+    }
+
+    template <class Cmd, class Entry>
+    TypedPipeline<Entries..., Entry> append(impl::Command<Cmd> &&cmd,
+                                            Entry &&entry) {
+      check_attached();
+      m_queue.append(std::move(cmd).cmd());
+      return {std::move(m_queue),
+              std::tuple_cat(std::move(m_entries),
+                             std::make_tuple(std::move(entry)))};
+    }
+
+    template <std::size_t... I>
+    result_type resolve(impl::CommandQueue &queue, std::index_sequence<I...>) {
+      // a braced-init-list is evaluated in order: replies are decoded as they
+      // are read
+      (void)queue;
+      return result_type{std::get<I>(m_entries).resolve(queue.get_reply())...};
+    }
+
+    template <class Visitor, std::size_t... I>
+    void visit(impl::CommandQueue &queue, Visitor &visitor,
+               std::index_sequence<I...>) {
+      (void)queue;
+      (void)visitor;
+      (visitor(std::get<I>(m_entries).resolve(queue.get_reply())), ...);
+    }
+  };
+} // namespace red1z
+
+#endif // RED1Z_TYPED_PIPELINE_H
@@ -0,0 +1,133 @@
+#include "red1z/async.h"
+
+#include <fcntl.h>
+
+namespace red1z {
+  namespace impl {
+    AsyncContext::AsyncContext(std::string const& hostname, int port, int db,
+                               std::optional<std::string> const& pass)
+      : m_ctx(hostname, port)
+    {
+      if (pass) {
+        m_ctx.add_handshake("AUTH", *pass);
+      }
+      if (db > 0) {
+        m_ctx.add_handshake("SELECT", std::to_string(db));
+      }
+      m_ctx.handshake();
+
+      int const fd = m_ctx.fd();
+      if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+        throw_system_error();
+      }
+    }
+
+    AsyncContext::~AsyncContext() {
+      //the event loop may be gone already
+      m_on_events = nullptr;
+      if (!m_broken) {
+        fail(std::make_exception_ptr(Error("connection destroyed")));
+      }
+    }
+
+    void AsyncContext::submit(std::string&& cmd, Completion* c) {
+      if (m_broken) {
+        std::rethrow_exception(m_broken);
+      }
+      bool const idle = m_out.empty();
+      m_out += cmd;
+      m_pending.push_back(c);
+      //commands queued until the socket is reported writable are sent
+      //together
+      if (idle and m_on_events) {
+        m_on_events(events());
+      }
+    }
+
+    void AsyncContext::on_writable() {
+      if (m_broken) {
+        return;
+      }
+      try {
+        while (m_out_pos < m_out.size()) {
+          auto r = send(fd(), m_out.data() + m_out_pos,
+                        m_out.size() - m_out_pos, MSG_NOSIGNAL);
+          if (r == -1) {
+            if (errno == EINTR) {
+              continue;
+            }
+            if (errno == EAGAIN or errno == EWOULDBLOCK) {
+              return;
+            }
+            throw_system_error();
+          }
+          m_out_pos += r;
+        }
+      }
+      catch (...) {
+        fail(std::current_exception());
+        return;
+      }
+      m_out.clear();
+      m_out_pos = 0;
+      if (m_on_events) {
+        m_on_events(events());
+      }
+    }
+
+    void AsyncContext::on_readable() {
+      constexpr std::size_t chunk = 16384;
+      m_in.resize(chunk);
+      while (!m_broken) {
+        auto r = recv(fd(), m_in.data(), chunk, 0);
+        try {
+          if (r == 0) {
+            throw Error("connection closed by the server");
+          }
+          if (r == -1) {
+            if (errno == EINTR) {
+              continue;
+            }
+            if (errno == EAGAIN or errno == EWOULDBLOCK) {
+              return;
+            }
+            throw_system_error();
+          }
+          m_parser.feed(std::string_view(m_in.data(), r));
+        }
+        catch (...) {
+          fail(std::current_exception());
+          return;
+        }
+
+        //complete every command whose reply is parsed, in order
+        while (auto result = m_parser.next()) {
+          if (m_pending.empty()) {
+            fail(std::make_exception_ptr(Error("unexpected reply")));
+            return;
+          }
+          auto c = m_pending.front();
+          m_pending.pop_front();
+          if (result->reply) {
+            c->complete(std::move(*result->reply));
+          }
+          else {
+            c->fail(std::make_exception_ptr(Error(result->error)));
+          }
+        }
+      }
+    }
+
+    void AsyncContext::fail(std::exception_ptr e) {
+      m_broken = e;
+      while (!m_pending.empty()) {
+        auto c = m_pending.front();
+        m_pending.pop_front();
+        c->fail(e);
+      }
+      if (m_on_events) {
+        m_on_events(events());
+      }
+    }
+  }
+}
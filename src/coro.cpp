@@ -0,0 +1,168 @@
+#include "red1z/coro.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace red1z {
+  namespace coro {
+    //owns the frame of a spawned task, destroyed once it completes
+    struct Reactor::Detached {
+      struct promise_type {
+        Detached get_return_object() {
+          return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+          return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+          return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+          std::terminate();
+        }
+      };
+    };
+
+    Reactor::Reactor() :
+      m_epoll(epoll_create1(EPOLL_CLOEXEC))
+    {
+      if (m_epoll == -1) {
+        red1z::impl::throw_system_error();
+      }
+    }
+
+    Reactor::~Reactor() {
+      close(m_epoll);
+    }
+
+    void Reactor::add(int fd, std::uint32_t events, Handler* h) {
+      epoll_event ev;
+      ev.events = events;
+      ev.data.ptr = h;
+      if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        red1z::impl::throw_system_error();
+      }
+    }
+
+    void Reactor::modify(int fd, std::uint32_t events, Handler* h) {
+      epoll_event ev;
+      ev.events = events;
+      ev.data.ptr = h;
+      if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) == -1) {
+        red1z::impl::throw_system_error();
+      }
+    }
+
+    void Reactor::remove(int fd, Handler* h) {
+      epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+      for (int i = 0; i < m_batch_size; ++i) {
+        if (m_batch[i] == h) {
+          m_batch[i] = nullptr;
+        }
+      }
+    }
+
+    Reactor::Detached Reactor::detach(Reactor& r, Task<> task) {
+      ++r.m_tasks;
+      try {
+        co_await task;
+      }
+      catch (...) {
+        if (!r.m_error) {
+          r.m_error = std::current_exception();
+        }
+      }
+      --r.m_tasks;
+    }
+
+    void Reactor::spawn(Task<> task) {
+      detach(*this, std::move(task));
+    }
+
+    void Reactor::run() {
+      while (run_once()) {
+      }
+      if (m_error) {
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+      }
+    }
+
+    bool Reactor::run_once(int timeout) {
+      if (m_tasks == 0 and m_posted.empty()) {
+        return false;
+      }
+      constexpr int N = 64;
+      epoll_event events[N];
+      int n = epoll_wait(m_epoll, events, N, m_posted.empty() ? timeout : 0);
+      if (n == -1 and errno != EINTR) {
+        red1z::impl::throw_system_error();
+      }
+      //a handler may remove another one of the batch, which is then skipped
+      Handler* handlers[N];
+      m_batch = handlers;
+      m_batch_size = std::max(n, 0);
+      for (int i = 0; i < m_batch_size; ++i) {
+        handlers[i] = static_cast<Handler*>(events[i].data.ptr);
+      }
+      for (int i = 0; i < m_batch_size; ++i) {
+        if (auto h = handlers[i]) {
+          h->on_events(events[i].events);
+        }
+      }
+      m_batch_size = 0;
+      m_batch = nullptr;
+      for (auto& f : std::exchange(m_posted, {})) {
+        f();
+      }
+      return m_tasks > 0;
+    }
+
+    static std::uint32_t epoll_events(int ev) {
+      std::uint32_t r = 0;
+      if (ev & events::read) {
+        r |= EPOLLIN;
+      }
+      if (ev & events::write) {
+        r |= EPOLLOUT;
+      }
+      return r;
+    }
+
+    Redis::Redis(Reactor& reactor, std::string const& hostname, int port,
+                 int db, std::optional<std::string> pass)
+      : m_reactor(reactor), m_ctx(hostname, port, db, pass)
+    {
+      m_reactor.add(m_ctx.fd(), epoll_events(m_ctx.events()), this);
+      m_ctx.on_events_changed([this](int events) {
+        m_reactor.modify(m_ctx.fd(), epoll_events(events), this);
+      });
+    }
+
+    Redis::~Redis() {
+      m_reactor.remove(m_ctx.fd(), this);
+      //resuming the waiting tasks here would let them use this connection
+      //while it is destroyed
+      for (auto c : m_ctx.release_pending()) {
+        m_reactor.post([c] {
+          c->fail(std::make_exception_ptr(Error("connection destroyed")));
+        });
+      }
+    }
+
+    void Redis::on_events(std::uint32_t events) {
+      if (events & EPOLLOUT) {
+        m_ctx.on_writable();
+      }
+      if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        m_ctx.on_readable();
+      }
+    }
+  }
+}
@@ -0,0 +1,91 @@
+#include "red1z/decode_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace red1z {
+  DecodePool::DecodePool(unsigned threads, std::size_t min_elements) :
+    m_min_elements(min_elements)
+  {
+    m_workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+      m_workers.emplace_back([this] { work(); });
+    }
+  }
+
+  DecodePool::~DecodePool() {
+    {
+      std::lock_guard lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& t : m_workers) {
+      t.join();
+    }
+  }
+
+  void DecodePool::run(std::size_t n, Fn fn, void* ctx) {
+    std::lock_guard submit(m_submit);
+    std::unique_lock lock(m_mutex);
+    //a few chunks per thread balance uneven decoding costs
+    auto const chunks = 4 * (m_workers.size() + 1);
+    m_job = Job{};
+    m_job.fn = fn;
+    m_job.ctx = ctx;
+    m_job.size = n;
+    m_job.grain = std::max<std::size_t>(1, (n + chunks - 1) / chunks);
+    m_job.context = impl::current_decode_context();
+    //nested arrays are decoded by the thread decoding their parent
+    m_job.context.pool = nullptr;
+    ++m_generation;
+    m_cv.notify_all();
+
+    impl::DecodeScope scope(m_job.context);
+    take_chunks(lock);
+    m_done.wait(lock, [this] { return m_job.running == 0; });
+    auto error = std::exchange(m_job.error, nullptr);
+    m_job = Job{};
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  void DecodePool::work() {
+    std::size_t seen = 0;
+    std::unique_lock lock(m_mutex);
+    for (;;) {
+      m_cv.wait(lock, [&] { return m_stop or m_generation != seen; });
+      if (m_stop) {
+        return;
+      }
+      seen = m_generation;
+      impl::DecodeScope scope(m_job.context);
+      take_chunks(lock);
+    }
+  }
+
+  void DecodePool::take_chunks(std::unique_lock<std::mutex>& lock) {
+    while (m_job.next < m_job.size) {
+      auto const begin = m_job.next;
+      auto const end = std::min(m_job.size, begin + m_job.grain);
+      m_job.next = end;
+      ++m_job.running;
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        m_job.fn(m_job.ctx, begin, end);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+      if (error and !m_job.error) {
+        m_job.error = error;
+        m_job.next = m_job.size; //give up the remaining chunks
+      }
+      if (--m_job.running == 0 and m_job.next >= m_job.size) {
+        m_done.notify_all();
+      }
+    }
+  }
+}
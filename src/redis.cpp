@@ -1,14 +1,14 @@
 #include "red1z/red1z.h"
 
-#include <regex>
 #include <charconv>
 
 namespace red1z {
   impl::Passtrough commands;
 
   Redis::Redis(std::string const& hostname, int port, int db,
-               std::optional<std::string> pass, std::optional<std::string> user)
-    : m_ctx(hostname, port)
+               std::optional<std::string> pass, std::optional<std::string> user,
+               Options const& options)
+    : m_ctx(hostname, port, options)
   {
     (void) user; //silence warning
     /*
@@ -22,44 +22,168 @@ namespace red1z {
     */
 
     if (pass) {
-      m_ctx.run("AUTH", *pass);
+      m_ctx.add_handshake("AUTH", *pass);
     }
 
     if (db > 0) {
-      m_ctx.run("SELECT", std::to_string(db));
+      m_ctx.add_handshake("SELECT", std::to_string(db));
+    }
+
+    if (!options.client_name.empty()) {
+      m_ctx.add_handshake("CLIENT", "SETNAME", options.client_name);
+    }
+    //a single round trip, along with the SYN with TCP fast open
+    m_ctx.handshake();
+  }
+
+  namespace {
+    //a whole non negative decimal number
+    bool parse_number(std::string_view s, int& n) {
+      auto const end = s.data() + s.size();
+      return !s.empty() and s.front() >= '0' and s.front() <= '9' and
+        std::from_chars(s.data(), end, n).ptr == end;
+    }
+
+    //a ?name=value parameter of a URL, overriding a connection option
+    void apply_parameter(Options& o, std::string_view url,
+                         std::string_view name, std::string_view value) {
+      auto number = [&] {
+        int n = 0;
+        if (!parse_number(value, n)) {
+          throw Error("invalid value of ", name, " in redis URL ", url);
+        }
+        return n;
+      };
+      auto flag = [&] {
+        if (value == "1" or value == "true" or value == "yes") {
+          return true;
+        }
+        if (value == "0" or value == "false" or value == "no") {
+          return false;
+        }
+        throw Error("invalid value of ", name, " in redis URL ", url);
+      };
+      using std::chrono::milliseconds;
+      using std::chrono::seconds;
+      if (name == "connect_timeout") {
+        o.connect_timeout = milliseconds(number());
+      }
+      else if (name == "read_timeout") {
+        o.read_timeout = milliseconds(number());
+      }
+      else if (name == "write_timeout") {
+        o.write_timeout = milliseconds(number());
+      }
+      else if (name == "name") {
+        o.client_name = value;
+      }
+      else if (name == "fast_open") {
+        o.fast_open = flag();
+      }
+      else if (name == "nodelay") {
+        o.tcp_nodelay = flag();
+      }
+      else if (name == "sndbuf") {
+        o.send_buffer = number();
+      }
+      else if (name == "rcvbuf") {
+        o.receive_buffer = number();
+      }
+      else if (name == "quickack") {
+        o.quickack = flag();
+      }
+      else if (name == "keepalive") {
+        o.keepalive_idle = seconds(number());
+      }
+      else if (name == "keepalive_interval") {
+        o.keepalive_interval = seconds(number());
+      }
+      else if (name == "keepalive_count") {
+        o.keepalive_count = number();
+      }
+      else if (name == "busy_poll") {
+        o.busy_poll = number();
+      }
+      else if (name == "incoming_cpu") {
+        o.incoming_cpu = number();
+      }
+      else {
+        throw Error("unknown parameter ", name, " in redis URL ", url);
+      }
     }
   }
 
-  Redis Redis::from_url(std::string_view url) {
-    std::regex re("redis://(([^:/ ]+)?:([^@/ ]+)@)?([^@/ :]+)(:([0-9]+))?(/([0-9]{0,2}))?");
-    std::cmatch m;
-    if (!regex_match(std::begin(url), std::end(url), m, re)) {
-      throw Error("unable to parse redis URL ", url);
+  Redis Redis::from_url(std::string_view url, Options const& options) {
+    return Redis(Endpoint::parse(url, options));
+  }
+
+  Endpoint Endpoint::parse(std::string_view url, Options const& options) {
+    //redis://[[username]:password@]host[:port][/db][?name=value&...]
+    auto invalid = [url] { return Error("unable to parse redis URL ", url); };
+    constexpr std::string_view scheme = "redis://";
+    if (url.substr(0, scheme.size()) != scheme or url.find(' ') != url.npos) {
+      throw invalid();
+    }
+    auto authority = url.substr(scheme.size());
+    //the password may contain a '?', not a '@'
+    Options opts = options;
+    auto const at = authority.find('@');
+    if (auto const q = authority.find('?', at == authority.npos ? 0 : at);
+        q != authority.npos) {
+      for (auto query = authority.substr(q + 1); !query.empty(); ) {
+        auto const amp = query.find('&');
+        auto const param = query.substr(0, amp);
+        auto const eq = param.find('=');
+        if (eq == param.npos) {
+          throw invalid();
+        }
+        apply_parameter(opts, url, param.substr(0, eq), param.substr(eq + 1));
+        query.remove_prefix(amp == query.npos ? query.size() : amp + 1);
+      }
+      authority = authority.substr(0, q);
+    }
+    std::string_view path;
+    if (auto const slash = authority.find('/'); slash != authority.npos) {
+      path = authority.substr(slash + 1);
+      authority = authority.substr(0, slash);
     }
 
     std::optional<std::string> username;
     std::optional<std::string> password;
-    if (m[1].length()) {
-      if (m[2].length()) {
-        username = m[2].str();
+    if (auto const at = authority.find('@'); at != authority.npos) {
+      auto const userinfo = authority.substr(0, at);
+      auto const colon = userinfo.find(':');
+      if (colon == userinfo.npos or colon + 1 == userinfo.size()) {
+        throw invalid();
       }
-      password = m[3].str();
+      if (colon > 0) {
+        username = std::string(userinfo.substr(0, colon));
+      }
+      password = std::string(userinfo.substr(colon + 1));
+      authority.remove_prefix(at + 1);
     }
 
-    std::string hostname = m[4].str();
+    auto const colon = authority.find(':');
+    std::string hostname(authority.substr(0, colon));
+    if (hostname.empty() or hostname.find('@') != hostname.npos) {
+      throw invalid();
+    }
     int port = 6379;
-    if (m[5].length()) {
-      std::from_chars(m[6].first, m[6].second, port);
+    if (colon != authority.npos and
+        !parse_number(authority.substr(colon + 1), port)) {
+      throw invalid();
     }
 
     int db = 0;
-    if (m[8].length() ) {
-      std::from_chars(m[8].first, m[8].second, db);
+    if (!path.empty()) {
+      if (path.size() > 2 or !parse_number(path, db)) {
+        throw invalid();
+      }
       if (db >= 16) {
         throw Error("invalid DB index ", db);
       }
     }
 
-    return {hostname, port, db, password, username};
+    return {hostname, port, db, password, username, opts};
   }
 }
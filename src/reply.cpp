@@ -3,10 +3,16 @@
 
 using red1z::Error;
 
+#include <cstring>
 #include <iostream>
 
-static std::string _read_line(red1z::impl::Socket& sock) {
-  std::string line;
+//arrays read their elements recursively
+template <class Source>
+static red1z::impl::Rep _read_reply(Source& sock,
+                                    std::pmr::memory_resource* mr);
+
+template <class Source, class String>
+static void _read_line(Source& sock, String& line) {
   std::array<char, 2> c;
   for (;;) {
     auto buf = sock.peek();
@@ -15,7 +21,7 @@ static std::string _read_line(red1z::impl::Socket& sock) {
         line.reserve(line.size() + n);
         line.append(buf.data(), n);
         sock.discard(n+2);
-        return line;
+        return;
       }
     }
 
@@ -35,10 +41,17 @@ static std::string _read_line(red1z::impl::Socket& sock) {
     }
     line.append(c.data(), 2);
   }
+}
+
+template <class Source>
+static std::string _read_line(Source& sock) {
+  std::string line;
+  _read_line(sock, line);
   return line;
 }
 
-static std::int64_t _read_integer(red1z::impl::Socket& sock) {
+template <class Source>
+static std::int64_t _read_integer(Source& sock) {
   std::int64_t i = 0;
   auto const data = _read_line(sock);
   auto r = std::from_chars(&data[0], &data[data.size()], i);
@@ -48,20 +61,43 @@ static std::int64_t _read_integer(red1z::impl::Socket& sock) {
   return i;
 }
 
-static std::string read_simple_string(red1z::impl::Socket& sock) {
+template <class Source>
+static red1z::impl::Rep read_simple_string(Source& sock,
+                                            std::pmr::memory_resource* mr) {
+  if (mr) {
+    std::pmr::string line(mr);
+    _read_line(sock, line);
+    return line;
+  }
   return _read_line(sock);
 }
 
-static void read_error(red1z::impl::Socket& sock) {
-  auto const msg = _read_line(sock);
-  throw Error(msg);
+template <class Source>
+static red1z::impl::Rep read_error(Source& sock) {
+  return red1z::impl::ErrorReply{_read_line(sock)};
 }
 
-static std::int64_t read_integer(red1z::impl::Socket& sock) {
+template <class Source>
+static std::int64_t read_integer(Source& sock) {
   return _read_integer(sock);
 }
 
-static red1z::impl::Rep read_bulk_string(red1z::impl::Socket& sock) {
+template <class Source, class String>
+static String _read_bulk_data(Source& sock, String data,
+                              std::int64_t size) {
+  data.resize(size);
+  sock.read(data.data(), size);
+  char delim[2];
+  sock.read(delim, 2);
+  if (delim[0] != '\r' or delim[1] != '\n') {
+    throw Error("bad delimiter");
+  }
+  return data;
+}
+
+template <class Source>
+static red1z::impl::Rep read_bulk_string(Source& sock,
+                                         std::pmr::memory_resource* mr) {
   auto const size = _read_integer(sock);
   if (size == -1) {
     return std::nullopt;
@@ -70,19 +106,15 @@ static red1z::impl::Rep read_bulk_string(red1z::impl::Socket& sock) {
     throw Error("negative bulk string size: ", size);
   }
 
-  std::string data;
-  data.resize(size);
-  sock.read(data.data(), size);
-  char delim[2];
-  sock.read(delim, 2);
-  if (delim[0] != '\r' or delim[1] != '\n') {
-    throw Error("bad delimiter");
+  if (mr) {
+    return _read_bulk_data(sock, std::pmr::string(mr), size);
   }
-
-  return data;
+  return _read_bulk_data(sock, std::string(), size);
 }
 
-static red1z::impl::Rep read_array(red1z::impl::Socket& sock) {
+template <class Source>
+static red1z::impl::Rep read_array(Source& sock,
+                                   std::pmr::memory_resource* mr) {
   auto const size = _read_integer(sock);
   if (size == -1) {
     return std::nullopt;
@@ -91,31 +123,223 @@ static red1z::impl::Rep read_array(red1z::impl::Socket& sock) {
     throw Error("negative array size: ", size);
   }
 
-  std::vector<red1z::Reply> elements;
+  auto elements = mr ? red1z::impl::Array(mr) : red1z::impl::Array();
   elements.reserve(size);
   for (std::int64_t i = 0; i < size; ++i) {
-    elements.emplace_back(sock);
+    elements.emplace_back(_read_reply(sock, mr));
   }
 
   return elements;
 }
 
-red1z::impl::Rep red1z::impl::read_reply(red1z::impl::Socket& sock) {
+template <class Source>
+static red1z::impl::Rep _read_reply(Source& sock,
+                                    std::pmr::memory_resource* mr) {
   char type;
   sock.read(type);
   switch(type) {
   case '+':
-    return read_simple_string(sock);
+    return read_simple_string(sock, mr);
   case '-':
-    read_error(sock); break;
+    return read_error(sock);
   case ':':
     return read_integer(sock);
   case '$':
-    return read_bulk_string(sock);
+    return read_bulk_string(sock, mr);
   case '*':
-    return read_array(sock);
+    return read_array(sock, mr);
   default:
     throw Error("unexpected response type: ", type);
   }
   return std::nullopt;
 }
+
+namespace {
+  //reads a reply already received in memory, with the Socket interface
+  class BufferSource {
+    std::string_view m_data;
+  public:
+    explicit BufferSource(std::string_view data) : m_data(data) {}
+
+    std::string_view peek() const {
+      return m_data;
+    }
+
+    void discard(std::size_t n) {
+      check(n);
+      m_data.remove_prefix(n);
+    }
+
+    template <class T> void read(T& out) {
+      read(reinterpret_cast<char*>(&out), sizeof(T));
+    }
+
+    void read(char* out, std::int64_t n) {
+      check(n);
+      memcpy(out, m_data.data(), n);
+      m_data.remove_prefix(n);
+    }
+
+  private:
+    void check(std::size_t n) const {
+      if (n > m_data.size()) {
+        throw Error("incomplete reply");
+      }
+    }
+  };
+}
+
+namespace {
+  //line of a fixed maximum size, holding the lengths and integers parsed
+  //while skipping a reply
+  class ShortLine {
+    static constexpr std::size_t N = 32;
+    char m_data[N];
+    std::size_t m_size = 0;
+  public:
+    std::size_t size() const {
+      return m_size;
+    }
+
+    void reserve(std::size_t n) {
+      if (n > N) {
+        throw Error("line too long for a length or an integer");
+      }
+    }
+
+    void append(char const* data, std::size_t n) {
+      reserve(m_size + n);
+      memcpy(m_data + m_size, data, n);
+      m_size += n;
+    }
+
+    void push_back(char c) {
+      append(&c, 1);
+    }
+
+    std::int64_t integer() const {
+      std::int64_t i = 0;
+      auto r = std::from_chars(m_data, m_data + m_size, i);
+      if (r.ec != std::errc()) {
+        throw Error("unable to parse ", std::string_view(m_data, m_size),
+                    " as an integer");
+      }
+      return i;
+    }
+  };
+
+  //swallows a line
+  struct NoLine {
+    std::size_t size() const {
+      return 0;
+    }
+    void reserve(std::size_t) {}
+    void append(char const*, std::size_t) {}
+    void push_back(char) {}
+  };
+}
+
+template <class Source>
+static std::int64_t _read_length(Source& sock) {
+  ShortLine line;
+  _read_line(sock, line);
+  return line.integer();
+}
+
+template <class Source>
+static std::optional<std::string> _skip_reply(Source& sock) {
+  //the elements of arrays are counted instead of recursing
+  std::optional<std::string> error;
+  for (std::int64_t pending = 1; pending > 0; --pending) {
+    char type;
+    sock.read(type);
+    switch (type) {
+    case '+':
+    case ':': {
+      NoLine line;
+      _read_line(sock, line);
+      break;
+    }
+    case '-':
+      if (error) {
+        NoLine line;
+        _read_line(sock, line);
+      }
+      else {
+        error = _read_line(sock);
+      }
+      break;
+    case '$': {
+      auto const size = _read_length(sock);
+      if (size >= 0) {
+        sock.discard(size);
+        char delim[2];
+        sock.read(delim, 2);
+        if (delim[0] != '\r' or delim[1] != '\n') {
+          throw Error("bad delimiter");
+        }
+      }
+      break;
+    }
+    case '*': {
+      auto const size = _read_length(sock);
+      if (size > 0) {
+        pending += size;
+      }
+      break;
+    }
+    default:
+      throw Error("unexpected response type: ", type);
+    }
+  }
+  return error;
+}
+
+std::optional<std::string> red1z::impl::skip_reply(red1z::impl::Socket& sock) {
+  return _skip_reply(sock);
+}
+
+red1z::impl::Rep red1z::impl::read_reply(red1z::impl::Socket& sock,
+                                          std::pmr::memory_resource* mr) {
+  return _read_reply(sock, mr);
+}
+
+red1z::impl::Rep red1z::impl::read_reply(std::string_view data,
+                                          std::pmr::memory_resource* mr) {
+  BufferSource src(data);
+  return _read_reply(src, mr);
+}
+
+std::size_t red1z::impl::reply_size(std::string_view data) {
+  //walk the framing of the first reply without decoding anything
+  std::size_t pos = 0;
+  for (std::int64_t pending = 1; pending > 0; --pending) {
+    auto const eol = data.find("\r\n", pos);
+    if (eol == std::string_view::npos) {
+      return 0;
+    }
+    auto const type = data[pos];
+    std::int64_t n = 0;
+    if (type == '$' or type == '*') {
+      auto r = std::from_chars(data.data() + pos + 1, data.data() + eol, n);
+      if (r.ec != std::errc()) {
+        throw Error("unable to parse ", data.substr(pos + 1, eol - pos - 1),
+                    " as an integer");
+      }
+    }
+    else if (type != '+' and type != '-' and type != ':') {
+      throw Error("unexpected response type: ", type);
+    }
+    pos = eol + 2;
+    if (type == '$' and n >= 0) {
+      pos += n + 2;
+      if (pos > data.size()) {
+        return 0;
+      }
+    }
+    else if (type == '*' and n > 0) {
+      pending += n;
+    }
+  }
+  return pos;
+}
@@ -1,46 +1,366 @@
 #include "red1z/socket.h"
 
+#include <algorithm>
+#include <climits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <poll.h>
 
 namespace red1z {
   namespace impl {
+    namespace {
+      //reasons of the failures losing the connection
+      char const* const closed_by_peer = "connection closed by peer";
+      char const* const io_error = "I/O error";
+
+      struct Address {
+        sockaddr_storage addr;
+        socklen_t size;
+        int family;
+      };
+
+      //addresses resolved by getaddrinfo, shared by the connections
+      class ResolverCache {
+        struct Entry {
+          std::vector<Address> addresses;
+          std::chrono::steady_clock::time_point expiry;
+        };
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+
+      public:
+        static ResolverCache& instance() {
+          static ResolverCache cache;
+          return cache;
+        }
+
+        std::vector<Address> resolve(std::string const& host, int port,
+                                     std::chrono::seconds ttl) {
+          auto const key = host + ':' + std::to_string(port);
+          auto const now = std::chrono::steady_clock::now();
+          if (ttl.count() > 0) {
+            std::lock_guard lock(m_mutex);
+            auto it = m_entries.find(key);
+            if (it != m_entries.end() and it->second.expiry > now) {
+              return it->second.addresses;
+            }
+          }
+
+          addrinfo hints;
+          memset(&hints, 0, sizeof(addrinfo));
+          hints.ai_family = AF_UNSPEC;
+          hints.ai_socktype = SOCK_STREAM;
+          hints.ai_flags = AI_ADDRCONFIG;
+          addrinfo* res = nullptr;
+          int const rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+                                     &hints, &res);
+          if (rc != 0) {
+            throw Error("unable to resolve ", host, ": ", gai_strerror(rc));
+          }
+          std::vector<Address> addresses;
+          for (auto p = res; p; p = p->ai_next) {
+            Address a;
+            memcpy(&a.addr, p->ai_addr, p->ai_addrlen);
+            a.size = p->ai_addrlen;
+            a.family = p->ai_family;
+            addresses.push_back(a);
+          }
+          freeaddrinfo(res);
+
+          if (ttl.count() > 0) {
+            std::lock_guard lock(m_mutex);
+            m_entries[key] = {addresses, now + ttl};
+          }
+          return addresses;
+        }
+
+        //the address at `index` accepted a connection, try it first
+        void promote(std::string const& host, int port, std::size_t index) {
+          std::lock_guard lock(m_mutex);
+          auto it = m_entries.find(host + ':' + std::to_string(port));
+          if (it != m_entries.end() and index < it->second.addresses.size()) {
+            auto& a = it->second.addresses;
+            std::rotate(a.begin(), a.begin() + index, a.begin() + index + 1);
+          }
+        }
+
+        //no address accepted a connection, resolve again next time
+        void forget(std::string const& host, int port) {
+          std::lock_guard lock(m_mutex);
+          m_entries.erase(host + ':' + std::to_string(port));
+        }
+      };
+
+      //timeouts of blocking recv/send, enforced by the kernel
+      void set_timeout(int fd, int option, std::chrono::milliseconds t) {
+        if (t.count() <= 0) {
+          return;
+        }
+        timeval tv;
+        tv.tv_sec = t.count() / 1000;
+        tv.tv_usec = (t.count() % 1000) * 1000;
+        if (setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(timeval)) != 0) {
+          throw_system_error();
+        }
+      }
+    }
 
     SocketFd::SocketFd() :
-      m_fd(socket(AF_INET, SOCK_STREAM, 0))
+      m_fd(-1)
     {
-      if (m_fd == -1) {
-        impl::throw_system_error();
-      }
     }
 
     SocketFd::~SocketFd() {
-      close(m_fd);
+      if (m_fd != -1) {
+        close(m_fd);
+      }
     }
 
-    Socket::Socket(std::string const& host, int port) {
+    void SocketFd::reopen(int family) {
+      int const fd = socket(family, SOCK_STREAM, 0);
+      if (fd == -1) {
+        impl::throw_system_error();
+      }
+      if (m_fd != -1) {
+        close(m_fd);
+      }
+      m_fd = fd;
+    }
+
+    Socket::Socket(std::string const& host, int port, Options const& options) :
+      m_host(host),
+      m_port(port),
+      m_options(options)
+    {
       memset(&m_msg, 0, sizeof(msghdr));
+      open();
+    }
+
+    void Socket::reconnect() {
+      m_size = 0;
+      m_pos = 0;
+      open();
+      m_broken.store(nullptr, std::memory_order_release);
+    }
 
-      char buf[1024];
-      hostent srv, *psrv = nullptr;
-      int errnum;
-      if (gethostbyname_r(host.c_str(), &srv, buf, 1024, &psrv, &errnum) != 0 || !psrv) {
-        throw_system_error(errnum);
+    bool Socket::connection_lost() const {
+      auto const reason = m_broken.load(std::memory_order_acquire);
+      return reason == closed_by_peer or reason == io_error;
+    }
+
+    void Socket::open() {
+      auto& cache = ResolverCache::instance();
+      auto const addresses = cache.resolve(m_host, m_port,
+                                           m_options.resolve_cache_ttl);
+      //with fast open, connect() succeeds without a SYN and a refused address
+      //is only reported by the first write or read: the next addresses would
+      //not be tried
+      bool const fast_open = m_options.fast_open and addresses.size() == 1;
+      //the addresses are tried in turn, e.g. ::1 then 127.0.0.1
+      for (std::size_t i = 0; i < addresses.size(); ++i) {
+        auto const& a = addresses[i];
+        try {
+          m_fd.reopen(a.family);
+          configure(fast_open);
+          connect_to(reinterpret_cast<sockaddr const*>(&a.addr), a.size,
+                     m_options.connect_timeout);
+          if (i > 0) {
+            cache.promote(m_host, m_port, i);
+          }
+          break;
+        }
+        catch (Error const&) {
+          if (i + 1 == addresses.size()) {
+            cache.forget(m_host, m_port);
+            throw;
+          }
+        }
       }
+      set_timeout(m_fd, SO_RCVTIMEO, m_options.read_timeout);
+      set_timeout(m_fd, SO_SNDTIMEO, m_options.write_timeout);
+      m_unconfirmed = fast_open;
+    }
 
-      sockaddr_in addr;
-      memset(&addr, 0, sizeof(sockaddr_in));
-      addr.sin_family = AF_INET;
-      addr.sin_port = htons(port);
-      memcpy(&addr.sin_addr.s_addr, srv.h_addr_list[0], srv.h_length);
+    //the address failed before any reply, it is resolved again next time
+    void Socket::forget_unconfirmed() {
+      if (m_unconfirmed) {
+        m_unconfirmed = false;
+        ResolverCache::instance().forget(m_host, m_port);
+      }
+    }
 
-      if (connect(m_fd, (const sockaddr*)&addr, sizeof(sockaddr_in)) != 0) {
+    void Socket::configure(bool fast_open) {
+      auto const& o = m_options;
+      auto set = [this](int level, int option, int value) {
+        if (setsockopt(m_fd, level, option, &value, sizeof(int)) != 0) {
+          throw_system_error();
+        }
+      };
+      if (o.tcp_nodelay) {
+        set(IPPROTO_TCP, TCP_NODELAY, 1);
+      }
+      //before connect, for the window scale to account for them
+      if (o.send_buffer > 0) {
+        set(SOL_SOCKET, SO_SNDBUF, o.send_buffer);
+      }
+      if (o.receive_buffer > 0) {
+        set(SOL_SOCKET, SO_RCVBUF, o.receive_buffer);
+      }
+      if (o.keepalive_idle.count() > 0) {
+        set(SOL_SOCKET, SO_KEEPALIVE, 1);
+        set(IPPROTO_TCP, TCP_KEEPIDLE, o.keepalive_idle.count());
+        if (o.keepalive_interval.count() > 0) {
+          set(IPPROTO_TCP, TCP_KEEPINTVL, o.keepalive_interval.count());
+        }
+        if (o.keepalive_count > 0) {
+          set(IPPROTO_TCP, TCP_KEEPCNT, o.keepalive_count);
+        }
+      }
+#ifdef SO_BUSY_POLL
+      if (o.busy_poll > 0) {
+        set(SOL_SOCKET, SO_BUSY_POLL, o.busy_poll);
+      }
+#endif
+#ifdef SO_INCOMING_CPU
+      if (o.incoming_cpu >= 0) {
+        set(SOL_SOCKET, SO_INCOMING_CPU, o.incoming_cpu);
+      }
+#endif
+#ifdef TCP_FASTOPEN_CONNECT
+      if (fast_open) {
+        int const on = 1;
+        //unsupported by the kernel: a regular connection is fine
+        setsockopt(m_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(int));
+      }
+#else
+      (void)fast_open;
+#endif
+      if (o.quickack) {
+        quickack();
+      }
+    }
+
+    void Socket::quickack() {
+#ifdef TCP_QUICKACK
+      int const on = 1;
+      setsockopt(m_fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(int));
+#endif
+    }
+
+    void Socket::connect_to(sockaddr const* addr, socklen_t len,
+                            std::chrono::milliseconds timeout) {
+      if (timeout.count() <= 0) {
+        if (connect(m_fd, addr, len) != 0) {
+          throw_system_error();
+        }
+        return;
+      }
+      //non blocking connect, bounded by poll
+      int const flags = fcntl(m_fd, F_GETFL);
+      if (flags == -1 or fcntl(m_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        throw_system_error();
+      }
+      if (connect(m_fd, addr, len) != 0) {
+        if (errno != EINPROGRESS) {
+          throw_system_error();
+        }
+        pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int r = poll(&pfd, 1, timeout.count());
+        while (r == -1 and errno == EINTR) {
+          r = poll(&pfd, 1, timeout.count());
+        }
+        if (r == -1) {
+          throw_system_error();
+        }
+        if (r == 0) {
+          throw Timeout("connect timed out");
+        }
+        int err = 0;
+        socklen_t size = sizeof(int);
+        if (getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &size) != 0) {
+          throw_system_error();
+        }
+        if (err != 0) {
+          throw_system_error(err);
+        }
+      }
+      if (fcntl(m_fd, F_SETFL, flags) == -1) {
         throw_system_error();
       }
     }
 
+    void Socket::cancel() {
+      poison("operation cancelled");
+      //wakes up the threads blocked in recv or send
+      shutdown(m_fd, SHUT_RDWR);
+    }
+
+    void Socket::check() const {
+      if (auto reason = m_broken.load(std::memory_order_acquire)) {
+        throw Error("connection unusable: ", reason);
+      }
+    }
+
+    char const* Socket::poison(char const* reason) {
+      char const* first = nullptr;
+      if (m_broken.compare_exchange_strong(first, reason,
+                                           std::memory_order_acq_rel)) {
+        return reason;
+      }
+      return first;
+    }
+
+    void Socket::fail_io(char const* timeout) {
+      int const errnum = errno;
+      forget_unconfirmed();
+      //SO_RCVTIMEO and SO_SNDTIMEO expire with EAGAIN
+      bool const timed_out = errnum == EAGAIN or errnum == EWOULDBLOCK;
+      auto const reason = timed_out ? timeout : io_error;
+      if (auto first = poison(reason); first != reason) {
+        throw Error(first); //e.g. cancelled meanwhile
+      }
+      if (timed_out) {
+        throw Timeout(reason);
+      }
+      throw make_error(errnum);
+    }
+
+    void Socket::await(short events, char const* what) {
+      using namespace std::chrono;
+      pollfd pfd;
+      pfd.fd = m_fd;
+      pfd.events = events;
+      pfd.revents = 0;
+      for (;;) {
+        auto const left = ceil<milliseconds>(m_deadline - clock::now()).count();
+        int const r = poll(&pfd, 1, std::clamp<decltype(left)>(left, 0, INT_MAX));
+        if (r > 0) {
+          return;
+        }
+        if (r == 0) {
+          poison(what);
+          throw Timeout(what);
+        }
+        if (errno != EINTR) {
+          int const errnum = errno;
+          poison(io_error);
+          throw make_error(errnum);
+        }
+      }
+    }
+
     bool Socket::wait(int timeout) {
+      check();
       if (m_size - m_pos > 0) {
         //there are unconsumed data in the buffer !
         return true;
@@ -68,9 +388,7 @@ namespace red1z {
       } else {
         //read whatever must be discarded into buffer
         for (int remain = n - avail; remain > 0; ) {
-          int m = std::min(N, remain);
-          do_read(m_buf, m);
-          remain -= m;
+          remain -= do_read(m_buf, std::min(N, remain));
         }
         m_pos = m_size; //mark buffer as empty
       }
@@ -101,32 +419,56 @@ namespace red1z {
         }
         return;
       }
-      //fill up buffer
-      m_size = do_read(m_buf, N);
+      //fill up buffer, recv may return less than requested
+      m_size = 0;
+      while (m_size < n) {
+        m_size += do_read(m_buf + m_size, N - m_size);
+      }
       //copy from buffer
       ::memcpy(out, m_buf, n);
       m_pos = n;
     }
 
     std::int64_t Socket::do_read(char* out, std::int64_t n, int flags) {
+      check();
+      if (m_deadline != clock::time_point::max()) {
+        await(POLLIN, "read deadline expired");
+      }
       auto r = recv(m_fd, out, n, flags);
       while (r == -1 && errno == EINTR) {
         r = recv(m_fd, out, n, flags);
       };
 
       if (r == -1) {
-        throw_system_error();
+        fail_io("read timed out");
+      }
+      if (r == 0 and n > 0) {
+        forget_unconfirmed();
+        throw Error(poison(closed_by_peer));
+      }
+      m_unconfirmed = false;
+      if (m_options.quickack) {
+        quickack();
       }
       return r;
     }
 
     void Socket::write(char const* data, std::int64_t n) {
-      auto r = send(m_fd, data, n, 0);
-      while (r == -1 and errno == EINTR) {
-        r = send(m_fd, data, n, 0);
-      }
-      if (r == -1) {
-        throw_system_error();
+      check();
+      //the peer may only accept part of the data, keep sending the rest
+      while (n > 0) {
+        if (m_deadline != clock::time_point::max()) {
+          await(POLLOUT, "write deadline expired");
+        }
+        auto r = send(m_fd, data, n, MSG_NOSIGNAL);
+        while (r == -1 and errno == EINTR) {
+          r = send(m_fd, data, n, MSG_NOSIGNAL);
+        }
+        if (r == -1) {
+          fail_io("write timed out");
+        }
+        data += r;
+        n -= r;
       }
     }
 
@@ -134,50 +476,41 @@ namespace red1z {
       if (data.empty()) {
         return;
       }
+      check();
       m_iov_queue.clear();
       m_iov_queue.reserve(data.size());
 
-      std::int64_t n = 0;
       for (auto const& cmd : data) {
         iovec iov;
         iov.iov_base = (void*) cmd.data();
         iov.iov_len = cmd.size();
-        n += iov.iov_len;
-
         m_iov_queue.push_back(iov);
       }
-      m_msg.msg_iov = m_iov_queue.data();
-      m_msg.msg_iovlen = m_iov_queue.size();
-      auto ret = sendmsg(m_fd, &m_msg, 0);
-      while (ret == -1 and errno == EINTR) {
-        ret = sendmsg(m_fd, &m_msg, 0);
-      }
-
-      while (ret >= 0 and ret < n) {
-        for (auto& io : m_iov_queue) {
-          if (static_cast<std::size_t>(ret) >= io.iov_len) {
-            //full block sent : remove from m_msg
-            ret -= io.iov_len;
-            ++m_msg.msg_iov;
-            --m_msg.msg_iovlen;
-            n -= io.iov_len;
-          }
-          else {
-            //partialy or not sent block : adjust and keep remaining blocks
-            auto const sent = n - ret;
-            io.iov_len -= sent;
-            io.iov_base = reinterpret_cast<char*>(io.iov_base) + sent;
-            break;
-          }
+
+      auto it = m_iov_queue.begin();
+      auto const end = m_iov_queue.end();
+      while (it != end) {
+        //sendmsg accepts at most IOV_MAX blocks at once
+        m_msg.msg_iov = &*it;
+        m_msg.msg_iovlen = std::min<std::size_t>(end - it, IOV_MAX);
+        if (m_deadline != clock::time_point::max()) {
+          await(POLLOUT, "write deadline expired");
         }
-        ret = sendmsg(m_fd, &m_msg, 0);
+        auto ret = sendmsg(m_fd, &m_msg, MSG_NOSIGNAL);
         while (ret == -1 and errno == EINTR) {
-          ret = sendmsg(m_fd, &m_msg, 0);
+          ret = sendmsg(m_fd, &m_msg, MSG_NOSIGNAL);
+        }
+        if (ret == -1) {
+          fail_io("write timed out");
+        }
+        //drop the fully sent blocks, adjust the partially sent one
+        for (; it != end and static_cast<std::size_t>(ret) >= it->iov_len; ++it) {
+          ret -= it->iov_len;
+        }
+        if (it != end) {
+          it->iov_base = reinterpret_cast<char*>(it->iov_base) + ret;
+          it->iov_len -= ret;
         }
-      }
-
-      if (ret == -1) {
-        throw_system_error();
       }
     }
   }